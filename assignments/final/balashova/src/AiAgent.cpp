@@ -5,10 +5,6 @@
 #include <cstring>
 //#include <iostream>
 
-#include <openssl/ssl.h>
-#include <openssl/err.h>
-#include <sys/socket.h>
-#include <netdb.h>
 #include <unistd.h>
 
 using nlohmann::json;
@@ -29,6 +25,8 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
     try {
         auto j = json::parse(s);
 
+        if (j.contains("prompts_path")) cfg_.prompts_path = j.at("prompts_path").get<std::string>();
+
         // mode
         if (j.contains("mode")) cfg_.mode = j.at("mode").get<std::string>();
         else { if (err) *err = "config.json: missing 'mode'"; return false; }
@@ -39,6 +37,8 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
             cfg_.hurated.host = h.at("host").get<std::string>();
             cfg_.hurated.api_key = h.at("api_key").get<std::string>();
             if (h.contains("port")) cfg_.hurated.port = h.at("port").get<std::string>();
+            if (h.contains("context_tokens")) cfg_.hurated.context_tokens = h.at("context_tokens").get<int>();
+            if (h.contains("answer_tokens")) cfg_.hurated.answer_tokens = h.at("answer_tokens").get<int>();
         } else if (cfg_.mode == "local") {
             if (!j.contains("local")) { if (err) *err = "config.json: missing 'local' section"; return false; }
             auto l = j.at("local");
@@ -46,15 +46,23 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
             cfg_.local.model_path = l.at("model_path").get<std::string>();
             if (l.contains("port")) cfg_.local.port = l.at("port").get<std::string>();
             if (l.contains("context_length")) cfg_.local.context_length = l.at("context_length").get<int>();
+            if (l.contains("answer_tokens")) cfg_.local.answer_tokens = l.at("answer_tokens").get<int>();
             if (l.contains("extra_args")) cfg_.local.extra_args = l.at("extra_args").get<std::string>();
+            if (l.contains("pidfile")) cfg_.local.pidfile = l.at("pidfile").get<std::string>();
+            if (l.contains("keep_server")) cfg_.local.keep_server = l.at("keep_server").get<bool>();
+            if (l.contains("startup_timeout")) cfg_.local.startup_timeout = l.at("startup_timeout").get<int>();
+            if (l.contains("slot_save_path")) cfg_.local.slot_save_path = l.at("slot_save_path").get<std::string>();
+            if (l.contains("slot_id")) cfg_.local.slot_id = l.at("slot_id").get<int>();
             
-            startLocalServer(err);
+            // Модель грузится, пока пользователь выбирает язык и тему;
+            // готовности ждём перед первым запросом
+            if (!startLocalServer(err)) return false;
         } else {
             if (err) *err = "Unsupported mode: " + cfg_.mode;
             return false;
         }
 
-        return true;
+        return loadTemplates(err);
     } catch (const std::exception& e) {
         if (err) *err = std::string("Config parse error: ") + e.what();
         return false;
@@ -84,13 +92,13 @@ bool AiAgent::loadPrompt(const std::string& path, std::string* err) {
 }
 
 // ------- Простейший разбор JSON: ожидаем { "text": "<строка>" } -------
-std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
-    // Если вместе с HTTP-хедерами — отрежем их
+std::string AiAgent::extractTextFromJsonBody(std::string_view body) {
+    // Если вместе с HTTP-хедерами — отрежем их (без копирования тела)
     const auto p = body.find("\r\n\r\n");
-    const std::string json_part = (p != std::string::npos) ? body.substr(p + 4) : body;
+    if (p != std::string_view::npos) body.remove_prefix(p + 4);
 
     try {
-        auto j = json::parse(json_part);
+        auto j = json::parse(body.begin(), body.end());
         return j.at("text").get<std::string>();  // строго ожидаем поле "text"
     } catch (...) {
         return {};
@@ -100,68 +108,15 @@ std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
 // -------- Низкоуровневый HTTPS POST на /api/generate --------
 std::optional<std::string> AiAgent::httpsPostGenerate(
         const HuratedCfg& cfg, const std::string& jsonBody, std::string* err) {
-    SSL_library_init();
-    SSL_load_error_strings();
-    OpenSSL_add_all_algorithms();
-
-    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
-    if (!ctx) { if (err) *err = "SSL_CTX_new failed"; return std::nullopt; }
-
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { if (err) *err = "socket failed"; SSL_CTX_free(ctx); return std::nullopt; }
-
-    struct addrinfo hints = {}, *res = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &res) != 0) {
-        if (err) *err = "getaddrinfo failed";
-        close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    if (connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
-        if (err) *err = "connect failed";
-        freeaddrinfo(res); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-    freeaddrinfo(res);
-
-    SSL* ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, sock);
-    if (SSL_connect(ssl) <= 0) {
-        if (err) *err = "SSL_connect failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    // HTTP запрос
-    std::ostringstream req;
-    req << "POST /api/generate HTTP/1.1\r\n"
-        << "Host: " << cfg.host << "\r\n"
-        << "Content-Type: application/json\r\n"
-        << "Connection: close\r\n";
-    if (!cfg.api_key.empty()) req << "x-api-key: " << cfg.api_key << "\r\n";
-    req << "Content-Length: " << jsonBody.size() << "\r\n\r\n"
-        << jsonBody;
-
-    const std::string request_str = req.str();
-    if (SSL_write(ssl, request_str.c_str(), (int)request_str.size()) <= 0) {
-        if (err) *err = "SSL_write failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    char buf[4096];
-    std::string response;
-    int bytes;
-    while ((bytes = SSL_read(ssl, buf, sizeof(buf)-1)) > 0) {
-        buf[bytes] = '\0';
-        response += buf;
-    }
+    std::string headers;
+    if (!cfg.api_key.empty()) headers += "x-api-key: " + cfg.api_key + "\r\n";
 
-    SSL_free(ssl);
-    close(sock);
-    SSL_CTX_free(ctx);
+    // Соединение берётся из пула: повторные запросы идут без нового рукопожатия
+    auto response = pool_.post(cfg.host, cfg.port, "/api/generate", headers, jsonBody, err);
+    if (!response) return std::nullopt;
 
     // ----- Используем nlohmann::json для извлечения "text" -----
-    std::string text = extractTextFromJsonBody(response);
+    std::string text = extractTextFromJsonBody(response->body());
     if (text.empty()) {
         if (err) *err = "Cannot extract \"text\" from JSON response";
         return std::nullopt;
@@ -1,32 +1,43 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <nlohmann/json.hpp>
 #include <sqlite3.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include "HttpsPool.h"
+#include "ModelServer.h"
+#include "PromptTemplate.h"
 
 struct HuratedCfg {
     std::string host;
     std::string port = "443";
     std::string api_key;
+    int context_tokens = 4096;  // окно контекста удалённой модели
+    int answer_tokens = 512;    // сколько оставить под ответ
 };
 
 struct LocalCfg {
     std::string backend;    // "llama.cpp"
     std::string model_path;
     int context_length = 2048;
+    int answer_tokens = 512;    // n_predict: сколько оставить под ответ
     std::string port = "8080";
-    std::string extra_args;
-    int server_pid;
-    bool server_running = false;
+    std::string extra_args;             // делятся по пробелам, без кавычек
+    std::string pidfile = "llama-server.pid";
+    bool keep_server = true;            // оставлять сервер с моделью между запусками
+    int startup_timeout = 120;          // сколько ждать загрузки модели, секунд
+    std::string slot_save_path = "kv_cache"; // снимки KV-кэша сессий; пусто — выключены
+    int slot_id = 0;                    // слот сервера, в котором идёт диалог
 };
 
 struct AiConfig {
     std::string mode; // "hurated" or "local"
     HuratedCfg hurated;
     LocalCfg local;
+    std::string prompts_path = "prompts"; // каталог с шаблонами системного промпта
 };
 
 struct LearningSession {
@@ -62,6 +73,9 @@ public:
     bool createSession(const std::string& language, const std::string& level, 
                       const std::string& topic, std::string* err = nullptr);
 
+    // Продолжить сессию из базы по её id
+    bool resumeSession(int id, std::string* err = nullptr);
+
     // Получить историю диалога для текущей сессии
     std::string getConversationHistory(std::string* err = nullptr);
 
@@ -71,18 +85,31 @@ public:
     // Получить текущую активную сессию
     const LearningSession& getCurrentSession() const { return currentSession_; }
     
+    // Запустить llama-server или подхватить уже работающий (см. ModelServer)
     bool startLocalServer(std::string* err);
+    // При выходе: KV-кэш сессии сохраняется в снимок, сервер
+    // останавливается, только если keep_server выключен
     void stopLocalServer();
 
 private:
     // Низкоуровневый HTTPS POST запрос
-    static std::optional<std::string> httpsPostGenerate(
+    std::optional<std::string> httpsPostGenerate(
         const HuratedCfg& cfg, const std::string& jsonBody, std::string* err);
         
     std::optional<std::string> localPostGenerate(
         const LocalCfg& cfg, const std::string& prompt, std::string* err);
+    // POST к llama-server, возвращает тело ответа
+    std::optional<std::string> localRequest(
+        const LocalCfg& cfg, const std::string& target, const std::string& body, std::string* err);
+
+    // Снимок KV-кэша слота для текущей сессии (POST /slots/<id>?action=...).
+    // Поднимается перед первым запросом сессии, сохраняется при уходе из неё
+    std::string sessionCacheName() const;
+    bool slotAction(const std::string& action, std::string* err);
+    void restoreSessionCache();
+    void saveSessionCache();
     // Извлечь текст из JSON ответа
-    static std::string extractTextFromJsonBody(const std::string& body);
+    static std::string extractTextFromJsonBody(std::string_view body);
 
     // Прочитать файл целиком
     static bool readWholeFile(const std::string& path, std::string& out, std::string* err);
@@ -90,6 +117,9 @@ private:
     // Добавить сообщение в историю диалога
     bool addMessageToHistory(const std::string& role, const std::string& content, std::string* err = nullptr);
 
+    // Разобрать шаблоны системного промпта из cfg_.prompts_path
+    bool loadTemplates(std::string* err);
+
     // Сгенерировать системный промпт для обучения языку
     std::string generateSystemPrompt() const;
 
@@ -98,4 +128,17 @@ private:
     sqlite3* db_ = nullptr;
     LearningSession currentSession_;
     std::string prompt_;
+
+    // Шаблоны разбираются один раз при загрузке конфига, а системный
+    // промпт рендерится один раз на сессию
+    PromptTemplate system_tpl_;
+    PromptTemplate hurated_rules_tpl_;
+    std::string system_prompt_;
+
+    // keep-alive соединения к Hurated API переживают отдельные сообщения
+    HttpsPool pool_;
+
+    ModelServer server_;
+    bool cache_restore_pending_ = false;
+    bool cache_dirty_ = false;      // в этой сессии были ответы локальной модели
 };
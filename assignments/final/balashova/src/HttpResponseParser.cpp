@@ -0,0 +1,203 @@
+#include "HttpResponseParser.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+
+namespace {
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+std::string toLower(std::string_view s) {
+    std::string out(s);
+    std::transform(out.begin(), out.end(), out.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return out;
+}
+
+bool containsToken(std::string_view value, std::string_view token) {
+    return toLower(value).find(token) != std::string::npos;
+}
+
+// Десятичное/шестнадцатеричное число без знака; false — мусор или переполнение
+bool parseNumber(std::string_view s, int base, size_t& out) {
+    if (s.empty()) return false;
+    out = 0;
+    for (char ch : s) {
+        int d;
+        if (ch >= '0' && ch <= '9') d = ch - '0';
+        else if (base == 16 && ch >= 'a' && ch <= 'f') d = ch - 'a' + 10;
+        else if (base == 16 && ch >= 'A' && ch <= 'F') d = ch - 'A' + 10;
+        else return false;
+        if (out > (SIZE_MAX - d) / base) return false;
+        out = out * base + d;
+    }
+    return true;
+}
+}
+
+void HttpResponseParser::fail(const char* what) {
+    state_ = State::Error;
+    error_ = what;
+}
+
+bool HttpResponseParser::keepAlive() const {
+    if (state_ != State::Done || until_eof_) return false;
+    return http11_ ? !conn_close_ : conn_keep_alive_;
+}
+
+bool HttpResponseParser::takeLine(const char*& p, const char* end) {
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    const char* stop = nl ? nl : end;
+    if (line_.size() + (stop - p) > kMaxLine) {
+        fail("HTTP line too long");
+        p = end;
+        return false;
+    }
+    line_.append(p, stop - p);
+    if (!nl) {
+        p = end;
+        return false;
+    }
+    p = nl + 1;
+    if (!line_.empty() && line_.back() == '\r') line_.pop_back();
+    return true;
+}
+
+size_t HttpResponseParser::feed(const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+
+    while (p < end && state_ != State::Done && state_ != State::Error) {
+        if (state_ == State::Body || state_ == State::ChunkData) {
+            const size_t n = until_eof_ ? size_t(end - p) : std::min(remaining_, size_t(end - p));
+            body_.reserve(body_.size() + n);
+            std::memcpy(body_.prepare(), p, n);
+            commitBody(n);
+            p += n;
+            continue;
+        }
+        if (!takeLine(p, end)) continue;
+        onLine();
+        line_.clear();
+    }
+    return p - data;
+}
+
+char* HttpResponseParser::bodySpace(size_t& room) {
+    if (state_ != State::Body && state_ != State::ChunkData) return nullptr;
+    char* dst = body_.prepare();
+    room = until_eof_ ? body_.available() : std::min(remaining_, body_.available());
+    return dst;
+}
+
+void HttpResponseParser::commitBody(size_t n) {
+    body_.commit(n);
+    if (body_.size() > kMaxBody) return fail("HTTP body too large");
+    if (until_eof_) return;
+    remaining_ -= n;
+    if (remaining_ > 0) return;
+    state_ = state_ == State::ChunkData ? State::ChunkEnd : State::Done;
+}
+
+void HttpResponseParser::onEof() {
+    if (state_ == State::Body && until_eof_) {
+        state_ = State::Done;
+        return;
+    }
+    if (state_ != State::Done && state_ != State::Error) {
+        fail(state_ == State::StatusLine && line_.empty() ? "connection closed by server"
+                                                         : "Truncated HTTP response");
+    }
+}
+
+void HttpResponseParser::onLine() {
+    std::string_view line = line_;
+
+    switch (state_) {
+    case State::StatusLine: {
+        // HTTP/1.1 200 OK
+        if (line.substr(0, 5) != "HTTP/") return fail("Invalid HTTP status line");
+        const auto sp = line.find(' ');
+        size_t code = 0;
+        if (sp == std::string_view::npos || !parseNumber(line.substr(sp + 1, 3), 10, code)) {
+            return fail("Invalid HTTP status line");
+        }
+        http11_ = line.substr(0, 8) == "HTTP/1.1";
+        status_ = static_cast<int>(code);
+        state_ = State::Headers;
+        return;
+    }
+    case State::Headers: {
+        if (line.empty()) return onHeadersEnd();
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos) return fail("Invalid HTTP header");
+        std::string name = toLower(trim(line.substr(0, colon)));
+        const std::string_view value = trim(line.substr(colon + 1));
+        if (name == "content-length") {
+            if (!parseNumber(value, 10, content_length_)) return fail("Invalid Content-Length");
+            has_length_ = true;
+        } else if (name == "transfer-encoding") {
+            chunked_ = containsToken(value, "chunked");
+        } else if (name == "connection") {
+            conn_close_ = containsToken(value, "close");
+            conn_keep_alive_ = containsToken(value, "keep-alive");
+        }
+        headers_.emplace_back(std::move(name), std::string(value));
+        return;
+    }
+    case State::ChunkSize: {
+        // Размер куска, возможно с расширениями после ';'
+        size_t size = 0;
+        if (!parseNumber(trim(line.substr(0, line.find(';'))), 16, size)) {
+            return fail("Invalid chunk size");
+        }
+        if (size == 0) {
+            state_ = State::Trailers;
+        } else if (size > kMaxBody - body_.size()) {
+            return fail("HTTP body too large");
+        } else {
+            remaining_ = size;
+            body_.reserve(body_.size() + std::min(size, kMaxReserve));
+            state_ = State::ChunkData;
+        }
+        return;
+    }
+    case State::ChunkEnd:
+        if (!line.empty()) return fail("Missing CRLF after chunk");
+        state_ = State::ChunkSize;
+        return;
+    case State::Trailers:
+        // Трейлеры не нужны — пропускаем до пустой строки
+        if (line.empty()) state_ = State::Done;
+        return;
+    default:
+        return;
+    }
+}
+
+void HttpResponseParser::onHeadersEnd() {
+    // Промежуточный ответ (100 Continue) — ждём настоящий
+    if (status_ >= 100 && status_ < 200) {
+        headers_.clear();
+        has_length_ = chunked_ = conn_close_ = conn_keep_alive_ = false;
+        state_ = State::StatusLine;
+        return;
+    }
+    if (status_ == 204 || status_ == 304) {
+        state_ = State::Done;
+    } else if (chunked_) {
+        state_ = State::ChunkSize;
+    } else if (has_length_) {
+        if (content_length_ > kMaxBody) return fail("HTTP body too large");
+        remaining_ = content_length_;
+        // Длина известна — место под тело выделяем сразу (в разумных пределах)
+        body_.reserve(std::min(content_length_, kMaxReserve));
+        state_ = content_length_ > 0 ? State::Body : State::Done;
+    } else {
+        until_eof_ = true;
+        state_ = State::Body;
+    }
+}
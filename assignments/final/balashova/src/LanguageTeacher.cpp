@@ -1,10 +1,13 @@
 #include "AiAgent.h"
+#include "HttpResponseParser.h"
+#include "TokenBudget.h"
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <cstring>
 #include <chrono>
 #include <iomanip>
+#include <filesystem>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -20,6 +23,7 @@ AiAgent::AiAgent() {
 }
 
 AiAgent::~AiAgent() {
+    saveSessionCache();
     if (db_) {
         sqlite3_close(db_);
     }
@@ -65,6 +69,18 @@ bool AiAgent::initDatabase(const std::string& dbPath, std::string* err) {
         return false;
     }
 
+    // История читается только в пределах сессии: индекс (session_id, timestamp)
+    // отдаёт последние N реплик, не трогая сообщения других сессий
+    const char* createHistoryIndex =
+        "CREATE INDEX IF NOT EXISTS idx_messages_session_time "
+        "ON conversation_messages (session_id, timestamp)";
+
+    if (sqlite3_exec(db_, createHistoryIndex, nullptr, nullptr, &errorMsg) != SQLITE_OK) {
+        if (err) *err = errorMsg;
+        sqlite3_free(errorMsg);
+        return false;
+    }
+
     return true;
 }
 
@@ -88,10 +104,15 @@ bool AiAgent::createSession(const std::string& language, const std::string& leve
         return false;
     }
 
+    saveSessionCache();
     currentSession_.id = sqlite3_last_insert_rowid(db_);
     currentSession_.language = language;
     currentSession_.level = level;
     currentSession_.topic = topic;
+    system_prompt_ = generateSystemPrompt();
+    // У новой сессии снимка нет
+    cache_restore_pending_ = false;
+    cache_dirty_ = false;
 
     std::string welcomeMsg = "Hello! I'm your " + language + " teacher. We'll be practicing " + 
                            topic + " at " + level + " level. How can I help you today?";
@@ -104,6 +125,41 @@ bool AiAgent::createSession(const std::string& language, const std::string& leve
     return true;
 }
 
+bool AiAgent::resumeSession(int id, std::string* err) {
+    const char* sql = "SELECT language, level, topic, created_at FROM learning_sessions WHERE id = ?";
+    sqlite3_stmt* stmt;
+
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        if (err) *err = sqlite3_errmsg(db_);
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, id);
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        if (err) *err = "Session " + std::to_string(id) + " not found";
+        sqlite3_finalize(stmt);
+        return false;
+    }
+
+    auto column = [stmt](int i) {
+        const char* s = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+        return std::string(s ? s : "");
+    };
+    saveSessionCache();
+    currentSession_.id = id;
+    currentSession_.language = column(0);
+    currentSession_.level = column(1);
+    currentSession_.topic = column(2);
+    currentSession_.created_at = column(3);
+    sqlite3_finalize(stmt);
+
+    system_prompt_ = generateSystemPrompt();
+    // История сессии уже посчитана раньше: KV-кэш поднимем из снимка
+    cache_restore_pending_ = true;
+    cache_dirty_ = false;
+    return true;
+}
+
 bool AiAgent::addMessageToHistory(const std::string& role, const std::string& content, std::string* err) {
     if (currentSession_.id == -1) {
         if (err) *err = "No active session";
@@ -138,42 +194,16 @@ std::string AiAgent::getConversationHistory(std::string* err) {
         return "";
     }
     
-    const char* sql;
-    if (cfg_.mode == "hurated") {
-        sql = R"(
-            SELECT role, content
-                FROM (
-                    SELECT *
-                    FROM conversation_messages
-                    ORDER BY timestamp DESC
-                    LIMIT 3
-                ) AS t
-                WHERE session_id = (
-                    SELECT id 
-                    FROM learning_sessions 
-                    ORDER BY created_at DESC 
-                    LIMIT 1
-                )
-                ORDER BY timestamp ASC
-            )";
-    } else {
-        sql = R"(
-            SELECT role, content
-                FROM (
-                    SELECT *
-                    FROM conversation_messages
-                    ORDER BY timestamp DESC
-                    LIMIT 1
-                ) AS t
-                WHERE session_id = (
-                    SELECT id 
-                    FROM learning_sessions 
-                    ORDER BY created_at DESC 
-                    LIMIT 1
-                )
-                ORDER BY timestamp ASC
-        )";
-    }
+    // Кандидаты — последние реплики текущей сессии, от новых к старым;
+    // id различает реплики с одинаковым временем
+    const char* sql = R"(
+        SELECT role, content
+            FROM conversation_messages
+            WHERE session_id = ?
+            ORDER BY timestamp DESC, id DESC
+            LIMIT ?
+    )";
+    const int kCandidates = 64;
     
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
@@ -181,30 +211,50 @@ std::string AiAgent::getConversationHistory(std::string* err) {
         return "";
     }
 
-    sqlite3_bind_int(stmt, 1, currentSession_.id);
+    sqlite3_bind_int64(stmt, 1, currentSession_.id);
+    sqlite3_bind_int(stmt, 2, kCandidates);
+
+    std::vector<std::pair<std::string, std::string>> rows;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        rows.emplace_back(role ? role : "", content ? content : "");
+    }
+    sqlite3_finalize(stmt);
     
+    const bool local = cfg_.mode == "local";
     std::string history;
-    if (cfg_.mode == "local") {
-        history += "<|im_start|>system\n" + generateSystemPrompt() + "<|im_end|>\n";
+    if (local) {
+        history += "<|im_start|>system\n" + system_prompt_ + "<|im_end|>\n";
     } else {
-        history = "system: " + generateSystemPrompt();
-    }
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::string role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        std::string content = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        history = "system: " + system_prompt_;
+    }
+
+    // Сколько реплик брать, решает окно контекста модели, а не их число:
+    // набираем от новых к старым, пока остаётся место под ответ
+    const int n_ctx = local ? cfg_.local.context_length : cfg_.hurated.context_tokens;
+    const int answer = local ? cfg_.local.answer_tokens : cfg_.hurated.answer_tokens;
+    const size_t budget = historyBudget((size_t)std::max(n_ctx, 0), (size_t)std::max(answer, 0),
+        approxTokens(history) + kMessageOverheadTokens);
+    // rows идут от новых к старым, а fitNewest считает с конца
+    const size_t kept = fitNewest(rows.size(), budget, [&](size_t i) {
+        const auto& row = rows[rows.size() - 1 - i];
+        return approxTokens(row.first) + approxTokens(row.second) + kMessageOverheadTokens;
+    });
+
+    for (size_t i = kept; i-- > 0;) {
+        const std::string& role = rows[i].first;
+        const std::string& content = rows[i].second;
         
         //history += role + ": " + content + "\n";
         
-        if (cfg_.mode == "local") {
+        if (local) {
             history += "<|im_start|>" + role + "\n" + content + "<|im_end|>\n";
         } else {
             history += role + ": " + content + "\n";
         }
-        
     }
 
-    sqlite3_finalize(stmt);
     if (cfg_.mode == "local") {
         history += "<|im_start|>assistant\n";
     } else {
@@ -213,76 +263,113 @@ std::string AiAgent::getConversationHistory(std::string* err) {
     return history;
 }
 
-std::string AiAgent::generateSystemPrompt() const {
-    std::string sys_prompt = "You are a friendly " + currentSession_.language + " language teacher. " +
-           "The student is at " + currentSession_.level + " level and wants to practice: " + 
-           currentSession_.topic + ". ";
+bool AiAgent::loadTemplates(std::string* err) {
+    const std::string dir = cfg_.prompts_path.empty() ? "." : cfg_.prompts_path;
+    auto sys = PromptTemplate::load(dir + "/system.txt", {"language", "level", "topic"}, err);
+    if (!sys) return false;
+    system_tpl_ = std::move(*sys);
+
     if (cfg_.mode == "hurated") {
-        sys_prompt += "Please:\n"
-           "1. Respond naturally in " + currentSession_.language + "\n"
-           "2. Correct mistakes gently and provide explanations, don't pay attention to the register in sentences.\n"
-           "3. Use appropriate vocabulary for their level\n"
-           "4. Encourage conversation and ask follow-up questions\n"
-           "5. Provide examples and practice exercises when helpful\n";
+        auto rules = PromptTemplate::load(dir + "/system_hurated_rules.txt", {"language"}, err);
+        if (!rules) return false;
+        hurated_rules_tpl_ = std::move(*rules);
     }
+    return true;
+}
+
+std::string AiAgent::generateSystemPrompt() const {
+    const auto& s = currentSession_;
+    const bool rules = cfg_.mode == "hurated";
+    std::string sys_prompt;
+    sys_prompt.reserve(system_tpl_.renderedSize({s.language, s.level, s.topic}) +
+        (rules ? hurated_rules_tpl_.renderedSize({s.language}) : 0));
+    system_tpl_.renderTo(sys_prompt, {s.language, s.level, s.topic});
+    if (rules) hurated_rules_tpl_.renderTo(sys_prompt, {s.language});
     return sys_prompt;
 }
 
 bool AiAgent::startLocalServer(std::string* err) {
-    
-    std::string cmd = cfg_.local.backend + 
-                     " -m \"" + cfg_.local.model_path + "\"" +
-                     " -c " + std::to_string(cfg_.local.context_length) +
-                     " --port " + cfg_.local.port +
-                     " --host 127.0.0.1" +
-                     " -np 4";
-    
-    if (!cfg_.local.extra_args.empty()) cmd += " " + cfg_.local.extra_args;
-    
-    int pipefd[2];
-    if (pipe(pipefd) != 0) {
-        if (err) *err = "pipe failed";
-        return false;
-    }
+    return server_.start(cfg_.local, err);
+}
 
-    cfg_.local.server_pid = fork();
-    if (cfg_.local.server_pid == -1) {
-        if (err) *err = "fork failed";
-        return false;
-    }
+void AiAgent::stopLocalServer() {
+    saveSessionCache();
+    if (!cfg_.local.keep_server) server_.stop();
+}
 
-    if (cfg_.local.server_pid == 0) {
-        // child process
-        close(pipefd[0]);
-        execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)NULL);
-        _exit(127);
-    } else {
-        // parent process
-        close(pipefd[1]);
-        if (waitpid(cfg_.local.server_pid, NULL, WNOHANG) == cfg_.local.server_pid) {
-            if (err) *err = "server failed to start";
-            cfg_.local.server_pid = -1;
+std::string AiAgent::sessionCacheName() const {
+    return "session-" + std::to_string(currentSession_.id) + ".bin";
+}
+
+bool AiAgent::slotAction(const std::string& action, std::string* err) {
+    const std::string target = "/slots/" + std::to_string(cfg_.local.slot_id) + "?action=" + action;
+    const json payload = { {"filename", sessionCacheName()} };
+    auto response = localRequest(cfg_.local, target, payload.dump(), err);
+    if (!response) return false;
+    try {
+        auto j = json::parse(*response);
+        if (j.contains("error")) {
+            if (err) *err = j["error"].value("message", j["error"].dump());
             return false;
         }
-        
-        cfg_.local.server_running = true;
-        return true;
+    } catch (...) {
+        if (err) *err = "Failed to parse llama.cpp slot response";
+        return false;
     }
+    return true;
 }
-    
-void AiAgent::stopLocalServer() {
-    if (cfg_.local.server_running) {
-        kill(cfg_.local.server_pid, SIGTERM);
 
-        int status;
-        waitpid(cfg_.local.server_pid, &status, 0);
+void AiAgent::restoreSessionCache() {
+    if (!cache_restore_pending_ || cfg_.local.slot_save_path.empty()) return;
+    cache_restore_pending_ = false;
+
+    // Снимка нет (сессия ни разу не доходила до выхода) — кэш наполнится по ходу
+    std::error_code ec;
+    if (!std::filesystem::exists(std::filesystem::path(cfg_.local.slot_save_path) / sessionCacheName(), ec)) {
+        return;
+    }
+    std::string err;
+    if (!slotAction("restore", &err)) {
+        std::cerr << "KV cache restore failed: " << err << "\n";
+    }
+}
 
-        cfg_.local.server_running = false;
+void AiAgent::saveSessionCache() {
+    if (!cache_dirty_ || cfg_.local.slot_save_path.empty() || currentSession_.id == -1) return;
+    cache_dirty_ = false;
+    std::string err;
+    if (!server_.alive() || !slotAction("save", &err)) {
+        std::cerr << "KV cache save failed: " << (err.empty() ? "server is not running" : err) << "\n";
     }
 }
 
 std::optional<std::string> AiAgent::localPostGenerate(
         const LocalCfg& cfg, const std::string& prompt, std::string* err) {
+    // Промпт сессии растёт только в конец (системный промпт, история, новая
+    // реплика), поэтому с cache_prompt сервер считает лишь новые токены.
+    // Слот фиксирован: его кэш сохраняется в снимок сессии
+    json payload = {
+        {"prompt", prompt},
+        {"n_predict", cfg.answer_tokens},
+        {"cache_prompt", true},
+        {"id_slot", cfg.slot_id}//,
+        //{"stop", json::array({"<|im_end|>"})}
+    };
+
+    auto response = localRequest(cfg, "/completion", payload.dump(), err);
+    if (!response) return std::nullopt;
+
+    try {
+        auto j = json::parse(*response);
+        return j.at("content").get<std::string>();
+    } catch (...) {
+        if (err) *err = "Failed to parse llama.cpp response";
+        return std::nullopt;
+    }
+}
+
+std::optional<std::string> AiAgent::localRequest(
+        const LocalCfg& cfg, const std::string& target, const std::string& body, std::string* err) {
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
         if (err) *err = "socket failed";
@@ -306,17 +393,9 @@ std::optional<std::string> AiAgent::localPostGenerate(
         return std::nullopt;
     }
     freeaddrinfo(res);
-    
-    json payload = {
-        {"prompt", prompt}//,
-        //{"stop", json::array({"<|im_end|>"})}
-    };
-
-    
-    std::string body = payload.dump();
 
     std::ostringstream req;
-    req << "POST /completion HTTP/1.1\r\n"
+    req << "POST " << target << " HTTP/1.1\r\n"
         << "Host: 127.0.0.1\r\n"
         << "Content-Type: application/json\r\n"
         << "Content-Length: " << body.size() << "\r\n"
@@ -327,30 +406,28 @@ std::optional<std::string> AiAgent::localPostGenerate(
     //std::cout << req.str() << "\n";
     send(sock, request.c_str(), request.size(), 0);
     
-    std::string response;
-    char buf[4096];
-    ssize_t n;
-    while ((n = recv(sock, buf, sizeof(buf) - 1, 0)) > 0) {
-        buf[n] = 0;
-        response += buf;
+    // Ответ разбираем по мере прихода; тело читается прямо в буфер парсера
+    HttpResponseParser parser;
+    char chunk[4096];
+    while (!parser.done() && !parser.failed()) {
+        size_t room = 0;
+        ssize_t n;
+        if (char* dst = parser.bodySpace(room)) {
+            n = recv(sock, dst, room, 0);
+            if (n > 0) parser.commitBody(n);
+        } else {
+            n = recv(sock, chunk, sizeof(chunk), 0);
+            if (n > 0) parser.feed(chunk, n);
+        }
+        if (n <= 0) parser.onEof();
     }
     close(sock);
 
-    auto pos = response.find("\r\n\r\n");
-    if (pos == std::string::npos) {
-        if (err) *err = "Invalid HTTP response";
-        return std::nullopt;
-    }
-
-    std::string json_part = response.substr(pos + 4);
-
-    try {
-        auto j = json::parse(json_part);
-        return j.at("content").get<std::string>();
-    } catch (...) {
-        if (err) *err = "Failed to parse llama.cpp response";
+    if (parser.failed()) {
+        if (err) *err = parser.error();
         return std::nullopt;
     }
+    return std::string(parser.body());
 }
 
 
@@ -374,7 +451,14 @@ std::optional<std::string> AiAgent::sendMessage(const std::string& message, std:
     std::optional<std::string> response;
     
     if (cfg_.mode == "local") {
-        response = localPostGenerate(cfg_.local, prompt_, outErr);    
+        if (!server_.waitReady(outErr)) return std::nullopt;
+        restoreSessionCache();
+        response = localPostGenerate(cfg_.local, prompt_, outErr);
+        // Сервер упал посреди запроса — поднимаем его и повторяем один раз
+        if (!response && !server_.alive() && server_.waitReady(outErr)) {
+            response = localPostGenerate(cfg_.local, prompt_, outErr);
+        }
+        if (response) cache_dirty_ = true;
     } else {
         json payload = { {"prompt", prompt_} };
         const std::string body = payload.dump();
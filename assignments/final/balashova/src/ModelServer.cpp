@@ -0,0 +1,297 @@
+#include "ModelServer.h"
+#include "AiAgent.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Блокировка pid-файла на время проверки и запуска: два агента,
+// стартующих одновременно, не поднимут два сервера
+class PidFileLock {
+public:
+    explicit PidFileLock(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ >= 0) ::flock(fd_, LOCK_EX);
+    }
+    ~PidFileLock() {
+        if (fd_ >= 0) {
+            ::flock(fd_, LOCK_UN);
+            ::close(fd_);
+        }
+    }
+private:
+    int fd_ = -1;
+};
+
+bool processExists(pid_t pid) {
+    return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+}
+
+} // namespace
+
+std::vector<std::string> ModelServer::args() const {
+    std::vector<std::string> args = {
+        binary_,
+        "-m", model_path_,
+        "-c", std::to_string(context_length_),
+        "--port", port_,
+        "--host", "127.0.0.1",
+        "-np", "4"
+    };
+    // Каталог снимков слотов: POST /slots/<id>?action=save|restore
+    if (!slot_save_path_.empty()) {
+        args.push_back("--slot-save-path");
+        args.push_back(slot_save_path_);
+    }
+    // Без shell кавычки не разбираются: extra_args делятся по пробелам
+    std::istringstream extra(extra_args_);
+    for (std::string arg; extra >> arg;) args.push_back(arg);
+    return args;
+}
+
+std::string ModelServer::identity() const {
+    std::string id;
+    for (const auto& arg : args()) {
+        id += arg;
+        id += ' ';
+    }
+    return id;
+}
+
+void ModelServer::writePidFile() const {
+    std::ofstream f(pidfile_, std::ios::trunc);
+    f << pid_ << '\n' << identity() << '\n';
+}
+
+bool ModelServer::start(const LocalCfg& cfg, std::string* err) {
+    binary_ = cfg.backend;
+    model_path_ = cfg.model_path;
+    port_ = cfg.port;
+    extra_args_ = cfg.extra_args;
+    pidfile_ = cfg.pidfile;
+    context_length_ = cfg.context_length;
+    startup_timeout_ = cfg.startup_timeout;
+    if (!cfg.slot_save_path.empty()) {
+        // Сервер может быть подхвачен из другого каталога: путь абсолютный
+        std::error_code ec;
+        std::filesystem::create_directories(cfg.slot_save_path, ec);
+        slot_save_path_ = std::filesystem::absolute(cfg.slot_save_path, ec).string();
+    }
+
+    PidFileLock lock(pidfile_);
+    std::ifstream f(pidfile_);
+    pid_t pid = -1;
+    std::string id;
+    if (f >> pid) {
+        f.ignore();
+        std::getline(f, id);
+    }
+    f.close();
+
+    // Сервер из прошлого запуска жив и слушает порт — подхватываем его.
+    // Порт проверяется, чтобы не принять за сервер чужой процесс с тем же pid
+    if (processExists(pid) && probe() != 0) {
+        if (id == identity()) {
+            pid_ = pid;
+            child_ = false;
+            adopted_ = true;
+            return true;
+        }
+        // Запущен с другой моделью или параметрами — заменяем
+        ::kill(pid, SIGTERM);
+        for (int i = 0; i < 50 && processExists(pid); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    return spawn(err);
+}
+
+bool ModelServer::spawn(std::string* err) {
+    const auto args = this->args();
+    std::vector<char*> argv;
+    for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    const std::string log = pidfile_ + ".log";
+
+    // Канал закрывается при успешном exec; если exec не удался, ребёнок
+    // пишет туда errno — так ошибка в пути к серверу видна сразу
+    int pipefd[2];
+    if (::pipe2(pipefd, O_CLOEXEC) != 0) {
+        if (err) *err = std::string("pipe failed: ") + std::strerror(errno);
+        return false;
+    }
+
+    const pid_t pid = ::fork();
+    if (pid == -1) {
+        if (err) *err = std::string("fork failed: ") + std::strerror(errno);
+        ::close(pipefd[0]);
+        ::close(pipefd[1]);
+        return false;
+    }
+    if (pid == 0) {
+        ::close(pipefd[0]);
+        // Своя сессия: сервер не получит SIGHUP/SIGINT терминала агента
+        ::setsid();
+        const int out = ::open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (out >= 0) {
+            ::dup2(out, STDOUT_FILENO);
+            ::dup2(out, STDERR_FILENO);
+            ::close(out);
+        }
+        const int in = ::open("/dev/null", O_RDONLY);
+        if (in >= 0) {
+            ::dup2(in, STDIN_FILENO);
+            ::close(in);
+        }
+        ::execvp(argv[0], argv.data());
+        const int code = errno;
+        (void)!::write(pipefd[1], &code, sizeof(code));
+        _exit(127);
+    }
+
+    ::close(pipefd[1]);
+    int code = 0;
+    ssize_t n;
+    while ((n = ::read(pipefd[0], &code, sizeof(code))) < 0 && errno == EINTR) {}
+    ::close(pipefd[0]);
+    if (n > 0) {
+        ::waitpid(pid, nullptr, 0);
+        if (err) *err = "cannot run " + binary_ + ": " + std::strerror(code);
+        return false;
+    }
+
+    pid_ = pid;
+    child_ = true;
+    adopted_ = false;
+    ready_ = false;
+    writePidFile();
+    return true;
+}
+
+bool ModelServer::alive() {
+    if (pid_ <= 0) return false;
+    if (child_) {
+        int status;
+        if (::waitpid(pid_, &status, WNOHANG) == pid_) {
+            pid_ = -1;
+            ready_ = false;
+            return false;
+        }
+        return true;
+    }
+    // Чужой процесс после смерти может остаться зомби, если его родитель
+    // не забирает статус, — поэтому живым считаем только отвечающий сервер
+    if (!processExists(pid_) || probe() == 0) {
+        pid_ = -1;
+        ready_ = false;
+        return false;
+    }
+    return true;
+}
+
+bool ModelServer::restart(std::string* err) {
+    if (restarts_ >= kMaxRestarts) {
+        if (err) *err = "local server keeps crashing, see " + pidfile_ + ".log";
+        return false;
+    }
+    ++restarts_;
+    std::cerr << "Local server is down, restarting (" << restarts_ << "/" << kMaxRestarts << ")\n";
+    PidFileLock lock(pidfile_);
+    return spawn(err);
+}
+
+bool ModelServer::waitReady(std::string* err) {
+    if (ready_ && alive()) return true;
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(startup_timeout_);
+    auto delay = std::chrono::milliseconds(20);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (!alive() && !restart(err)) return false;
+        if (probe() == 200) {
+            ready_ = true;
+            return true;
+        }
+        // Частый опрос в начале ловит уже готовый сервер почти без задержки,
+        // дальше интервал растёт до 500 мс
+        std::this_thread::sleep_for(delay);
+        delay = std::min(delay * 2, std::chrono::milliseconds(500));
+    }
+    if (err) *err = "local server is not ready after " + std::to_string(startup_timeout_) + " s";
+    return false;
+}
+
+void ModelServer::stop() {
+    if (pid_ > 0) {
+        ::kill(pid_, SIGTERM);
+        if (child_) {
+            int status;
+            ::waitpid(pid_, &status, 0);
+        } else {
+            for (int i = 0; i < 50 && processExists(pid_); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+    ::unlink(pidfile_.c_str());
+    pid_ = -1;
+    ready_ = false;
+}
+
+int ModelServer::probe() const {
+    struct addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo("127.0.0.1", port_.c_str(), &hints, &res) != 0) return 0;
+
+    const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        freeaddrinfo(res);
+        return 0;
+    }
+    struct timeval tv{1, 0};
+    ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    const bool connected = ::connect(sock, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!connected) {
+        ::close(sock);
+        return 0;
+    }
+
+    const std::string req = "GET /health HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    ::send(sock, req.data(), req.size(), 0);
+    // Нужна только строка статуса: "HTTP/1.1 200 OK"
+    char buf[64];
+    size_t got = 0;
+    while (got < sizeof(buf) - 1) {
+        const ssize_t n = ::recv(sock, buf + got, sizeof(buf) - 1 - got, 0);
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+        if (std::memchr(buf, '\n', got)) break;
+    }
+    // Дочитываем ответ до конца, чтобы сервер не упёрся в закрытый сокет
+    char rest[256];
+    while (::recv(sock, rest, sizeof(rest), 0) > 0) {}
+    ::close(sock);
+    buf[got] = '\0';
+    int status = 0;
+    if (std::sscanf(buf, "HTTP/%*s %d", &status) != 1) return -1;
+    return status;
+}
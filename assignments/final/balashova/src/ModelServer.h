@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct LocalCfg;
+
+// Супервизор локального llama-server.
+//
+// Сервер запускается без shell (fork + execvp) в своей сессии и переживает
+// выход агента: pid и параметры запуска пишутся в pid-файл, и следующий
+// запуск агента подхватывает уже загруженную модель вместо того, чтобы
+// грузить её заново. Готовность определяется опросом GET /health:
+// пока модель грузится, llama-server отвечает 503, после — 200.
+// Упавший сервер перезапускается (не больше kMaxRestarts раз за запуск).
+class ModelServer {
+public:
+    ModelServer() = default;
+
+    ModelServer(const ModelServer&) = delete;
+    ModelServer& operator=(const ModelServer&) = delete;
+
+    // Запустить сервер или подхватить работающий по pid-файлу.
+    // Загрузку модели не ждёт: она идёт, пока пользователь вводит данные
+    bool start(const LocalCfg& cfg, std::string* err = nullptr);
+
+    // Дождаться готовности модели; если сервер упал — перезапустить
+    bool waitReady(std::string* err = nullptr);
+
+    // Жив ли процесс сервера
+    bool alive();
+
+    // Остановить сервер и удалить pid-файл
+    void stop();
+
+    pid_t pid() const { return pid_; }
+    // Сервер подхвачен из прошлого запуска, а не запущен сейчас
+    bool adopted() const { return adopted_; }
+
+private:
+    static constexpr int kMaxRestarts = 3;
+
+    bool spawn(std::string* err);
+    bool restart(std::string* err);
+    std::vector<std::string> args() const;
+    // Строка параметров запуска: сервер из pid-файла подхватывается,
+    // только если он запущен с теми же параметрами
+    std::string identity() const;
+    void writePidFile() const;
+    // HTTP-статус GET /health; 0 — сервер не принимает соединения
+    int probe() const;
+
+    std::string binary_;
+    std::string model_path_;
+    std::string port_;
+    std::string extra_args_;
+    std::string pidfile_;
+    std::string slot_save_path_;
+    int context_length_ = 0;
+    int startup_timeout_ = 0;
+
+    pid_t pid_ = -1;
+    bool child_ = false;     // наш дочерний процесс: его нужно забирать waitpid
+    bool adopted_ = false;
+    bool ready_ = false;
+    int restarts_ = 0;
+};
@@ -0,0 +1,93 @@
+#include "PromptTemplate.h"
+#include <fstream>
+#include <sstream>
+
+std::optional<PromptTemplate> PromptTemplate::compile(std::string_view text,
+        std::initializer_list<std::string_view> slots, std::string* err) {
+    PromptTemplate t;
+    t.source_.assign(text);
+    t.slot_uses_.assign(slots.size(), 0);
+
+    auto addLiteral = [&t](std::string_view lit) {
+        if (lit.empty()) return;
+        // Соседние литералы склеиваем в один сегмент
+        if (!t.segments_.empty() && t.segments_.back().slot < 0) {
+            t.segments_.back().length += lit.size();
+        } else {
+            t.segments_.push_back({t.text_.size(), lit.size(), -1});
+        }
+        t.text_.append(lit);
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const size_t open = text.find("{{", pos);
+        if (open == std::string_view::npos) {
+            addLiteral(text.substr(pos));
+            break;
+        }
+        const size_t close = text.find("}}", open + 2);
+        if (close == std::string_view::npos) {
+            if (err) *err = "Unclosed '{{' at offset " + std::to_string(open);
+            return std::nullopt;
+        }
+        addLiteral(text.substr(pos, open - pos));
+
+        const std::string_view name = text.substr(open + 2, close - open - 2);
+        int index = -1;
+        int i = 0;
+        for (auto s : slots) {
+            if (s == name) { index = i; break; }
+            ++i;
+        }
+        if (index < 0) {
+            if (err) *err = "Unknown template slot: {{" + std::string(name) + "}}";
+            return std::nullopt;
+        }
+        t.segments_.push_back({0, 0, index});
+        ++t.slot_uses_[index];
+        pos = close + 2;
+    }
+
+    t.literal_size_ = t.text_.size();
+    return t;
+}
+
+std::optional<PromptTemplate> PromptTemplate::load(const std::string& path,
+        std::initializer_list<std::string_view> slots, std::string* err) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) { if (err) *err = "Cannot open template: " + path; return std::nullopt; }
+    std::ostringstream ss; ss << f.rdbuf();
+    const std::string text = std::move(ss).str();
+
+    std::string why;
+    auto t = compile(text, slots, &why);
+    if (!t && err) *err = path + ": " + why;
+    return t;
+}
+
+std::string_view PromptTemplate::valueAt(Values values, int slot) {
+    return (size_t)slot < values.size() ? values.begin()[slot] : std::string_view();
+}
+
+size_t PromptTemplate::renderedSize(Values values) const {
+    size_t size = literal_size_;
+    for (size_t i = 0; i < slot_uses_.size(); ++i) {
+        size += slot_uses_[i] * valueAt(values, (int)i).size();
+    }
+    return size;
+}
+
+void PromptTemplate::renderTo(std::string& out, Values values) const {
+    out.reserve(out.size() + renderedSize(values));
+    for (const auto& seg : segments_) {
+        if (seg.slot < 0) out.append(text_, seg.offset, seg.length);
+        else out.append(valueAt(values, seg.slot));
+    }
+}
+
+std::string PromptTemplate::render(Values values) const {
+    std::string out;
+    renderTo(out, values);
+    return out;
+}
@@ -0,0 +1,51 @@
+#include "TokenBudget.h"
+
+namespace {
+
+enum class Kind { Space, Newline, Latin, Other, Digit, Punct };
+
+Kind kindOf(unsigned char c) {
+    if (c == '\n' || c == '\r') return Kind::Newline;
+    if (c == ' ' || c == '\t') return Kind::Space;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return Kind::Latin;
+    if (c >= '0' && c <= '9') return Kind::Digit;
+    // Не-ASCII: кириллица, прочие алфавиты, эмодзи
+    if (c >= 0x80) return Kind::Other;
+    return Kind::Punct;
+}
+
+size_t ceilDiv(size_t a, size_t b) { return (a + b - 1) / b; }
+
+} // namespace
+
+size_t approxTokens(std::string_view text) {
+    size_t tokens = 0;
+    size_t i = 0;
+    const size_t n = text.size();
+    while (i < n) {
+        const Kind k = kindOf((unsigned char)text[i]);
+        size_t j = i + 1;
+        // Символы вне ASCII считаем по кодовым точкам, а не по байтам
+        size_t chars = 1;
+        while (j < n && kindOf((unsigned char)text[j]) == k) {
+            if (k != Kind::Other || ((unsigned char)text[j] & 0xC0) != 0x80) ++chars;
+            ++j;
+        }
+        const size_t len = j - i;
+
+        switch (k) {
+            case Kind::Space:
+                // Одиночный пробел перед словом BPE склеивает со словом
+                if (!(len == 1 && j < n && kindOf((unsigned char)text[j]) != Kind::Space
+                      && kindOf((unsigned char)text[j]) != Kind::Newline)) ++tokens;
+                break;
+            case Kind::Newline: tokens += 1; break;
+            case Kind::Latin:   tokens += ceilDiv(len, 4); break;
+            case Kind::Other:   tokens += ceilDiv(chars * 2, 5); break;
+            case Kind::Digit:   tokens += ceilDiv(len, 3); break;
+            case Kind::Punct:   tokens += len; break;
+        }
+        i = j;
+    }
+    return tokens;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+// Быстрая оценка длины текста в токенах BPE-токенизатора (llama/GPT) без
+// словаря. Текст режется на куски так же, как это делает претокенизатор
+// (буквы, цифры, пробелы, знаки), и для каждого куска берётся типичная
+// длина токена: ~4 байта латиницы, ~2.5 символа кириллицы, до 3 цифр.
+// Оценка намеренно немного завышена — лучше недобрать истории,
+// чем получить от сервера переполнение контекста.
+size_t approxTokens(std::string_view text);
+
+// Накладные токены на одно сообщение чата (роль, разделители шаблона)
+constexpr size_t kMessageOverheadTokens = 4;
+
+// Сколько токенов можно отдать под историю: окно контекста минус ответ
+// модели и неизменная часть промпта (системный промпт, запрос, обвязка)
+inline size_t historyBudget(size_t n_ctx, size_t answer_tokens, size_t fixed_tokens) {
+    const size_t reserved = answer_tokens + fixed_tokens;
+    return n_ctx > reserved ? n_ctx - reserved : 0;
+}
+
+// Сколько последних элементов из n (в хронологическом порядке) помещается
+// в budget. cost(i) — цена i-го элемента в токенах. Набираем с конца,
+// пока очередное сообщение влезает: история остаётся непрерывной
+template <class Cost>
+size_t fitNewest(size_t n, size_t budget, Cost cost) {
+    size_t used = 0, kept = 0;
+    while (kept < n) {
+        const size_t c = cost(n - 1 - kept);
+        if (used + c > budget) break;
+        used += c;
+        ++kept;
+    }
+    return kept;
+}
@@ -1,6 +1,7 @@
 #include "AiAgent.h"
 #include <iostream>
 #include <string>
+#include <cstdlib>
 
 int main(int argc, char **argv) {
     AiAgent teacher;
@@ -16,24 +17,39 @@ int main(int argc, char **argv) {
         return 1;
     }
        
-    std::string language, level, topic;
+    std::string language, level, topic, resume;
     
     std::cout << "Welcome to Language Learning AI!\n";
-    std::cout << "Enter language to learn (e.g., English, Spanish, French): ";
-    std::getline(std::cin, language);
-    
-    std::cout << "Enter your level (beginner, intermediate, advanced): ";
-    std::getline(std::cin, level);
-    
-    std::cout << "Enter topic you want to practice: ";
-    std::getline(std::cin, topic);
+    std::cout << "Enter session id to continue (empty for a new session): ";
+    std::getline(std::cin, resume);
 
-    if (!teacher.createSession(language, level, topic, &err)) {
-        std::cerr << "Session creation error: " << err << "\n";
-        return 1;
+    if (!resume.empty()) {
+        // Прошлая сессия: история в базе, KV-кэш модели — в снимке
+        if (!teacher.resumeSession(std::atoi(resume.c_str()), &err)) {
+            std::cerr << "Session resume error: " << err << "\n";
+            return 1;
+        }
+        language = teacher.getCurrentSession().language;
+        level = teacher.getCurrentSession().level;
+        topic = teacher.getCurrentSession().topic;
+    } else {
+        std::cout << "Enter language to learn (e.g., English, Spanish, French): ";
+        std::getline(std::cin, language);
+        
+        std::cout << "Enter your level (beginner, intermediate, advanced): ";
+        std::getline(std::cin, level);
+        
+        std::cout << "Enter topic you want to practice: ";
+        std::getline(std::cin, topic);
+
+        if (!teacher.createSession(language, level, topic, &err)) {
+            std::cerr << "Session creation error: " << err << "\n";
+            return 1;
+        }
     }
 
     std::cout << "\n=== Language Learning Session Started ===\n";
+    std::cout << "Session: " << teacher.getCurrentSession().id << "\n";
     std::cout << "Language: " << language << "\n";
     std::cout << "Level: " << level << "\n";
     std::cout << "Topic: " << topic << "\n";
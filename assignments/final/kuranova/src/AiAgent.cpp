@@ -37,6 +37,8 @@ int AiAgent::loadConfig(const std::string& path, std::string* err, std::string t
         cfg_.host   = j.at(tp + "host").get<std::string>();
         if (j.contains(tp + "port")) cfg_.port = j.at(tp + "port").get<std::string>();
         cfg_.mcount = j.at(tp + "mcount").get<int>();
+        if (j.contains(tp + "context_tokens")) cfg_.context_tokens = j.at(tp + "context_tokens").get<int>();
+        if (j.contains(tp + "answer_tokens")) cfg_.answer_tokens = j.at(tp + "answer_tokens").get<int>();
         cfg_.api_key = j.at("api_key").get<std::string>();
         return cfg_.mcount;
     } catch (const std::exception& e) {
@@ -158,18 +160,22 @@ std::optional<std::string> AiAgent::httpsPostGenerate(
 
 
 std::optional<std::string> AiAgent::ask(std::string* outErr) const {
+    return ask(prompt_, outErr);
+}
+
+std::optional<std::string> AiAgent::ask(const std::string& prompt, std::string* outErr) const {
     if (cfg_.host.empty() || cfg_.api_key.empty()) {
         if (outErr) *outErr = "Config not loaded or api_key/host missing";
         return std::nullopt;
     }
-    if (prompt_.empty()) {
+    if (prompt.empty()) {
         if (outErr) *outErr = "Prompt is empty (load it first)";
         return std::nullopt;
     }
     
     if (cfg_.is_loc == false) {
 		// Формируем корректный JSON тела через nlohmann/json
-		json payload = { {"prompt", prompt_} };
+		json payload = { {"prompt", prompt} };
 		const std::string body = payload.dump();
 
 		return httpsPostGenerate(cfg_, body, outErr);
@@ -179,11 +185,14 @@ std::optional<std::string> AiAgent::ask(std::string* outErr) const {
         {"model", "local-gguf"},
         {"messages", {
             {{"role", "system"}, {"content", "You are a helpful assistant for preparing for deadlines and exams."}},
-            {{"role", "user"}, {"content", prompt_}}
+            {{"role", "user"}, {"content", prompt}}
         }},
-        {"max_tokens", 2000},
+        {"max_tokens", cfg_.answer_tokens},
         {"temperature", 0.8},
-        {"top_p", 0.9}
+        {"top_p", 0.9},
+        // История в промпте идёт перед новым сообщением и растёт в конец:
+        // сервер берёт общий префикс из KV-кэша
+        {"cache_prompt", true}
     };
     // std::cout << prompt_ << std::endl;
 		try {
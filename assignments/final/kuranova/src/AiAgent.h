@@ -7,7 +7,9 @@ struct AiConfig {
     std::string host;
     std::string port = "443";
     std::string api_key;
-    int mcount;
+    int mcount;                 // сколько последних сообщений рассматривать
+    int context_tokens = 4096;  // окно контекста модели
+    int answer_tokens = 2000;   // сколько оставить под ответ
     bool is_loc;
 };
 
@@ -23,9 +25,15 @@ public:
     // Возвращает std::nullopt при ошибке (описание в outErr, если передан)
     std::optional<std::string> ask(std::string* outErr = nullptr) const;
 
+    // То же с переданным промптом. Состояние агента не меняется, поэтому
+    // вызов можно делать из нескольких потоков одновременно
+    std::optional<std::string> ask(const std::string& prompt, std::string* outErr = nullptr) const;
+
     // Явно задать промпт программно (не из файла)
     void setPrompt(std::string p) { prompt_ = std::move(p); }
 
+    const AiConfig& config() const { return cfg_; }
+
 private:
     // ---- низкоуровневые помощники ----
     static std::optional<std::string> httpsPostGenerate(
@@ -0,0 +1,68 @@
+#include "ReminderTimer.h"
+
+ReminderTimer::ReminderTimer(Clock::duration interval, Callback cb)
+    : interval_(interval), cb_(std::move(cb)) {}
+
+void ReminderTimer::touch(int session) {
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mtx_);
+    const bool was_empty = order_.empty();
+    auto it = index_.find(session);
+    if (it != index_.end()) {
+        // Новый дедлайн самый поздний — место сессии в конце списка
+        order_.splice(order_.end(), order_, it->second);
+        it->second->last = now;
+        it->second->deadline = now + interval_;
+    } else {
+        index_[session] = order_.insert(order_.end(), Entry{session, now, now + interval_});
+    }
+    // Если поток уже ждёт чей-то дедлайн, будить его незачем: голова списка
+    // могла только отодвинуться, и он просто уснёт снова
+    if (was_empty) cv_.notify_one();
+}
+
+void ReminderTimer::remove(int session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = index_.find(session);
+    if (it == index_.end()) return;
+    order_.erase(it->second);
+    index_.erase(it);
+}
+
+void ReminderTimer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+}
+
+void ReminderTimer::run() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!stop_) {
+        if (order_.empty()) {
+            cv_.wait(lock, [this] { return stop_ || !order_.empty(); });
+            continue;
+        }
+
+        const auto deadline = order_.front().deadline;
+        if (Clock::now() < deadline) {
+            cv_.wait_until(lock, deadline);
+            continue;
+        }
+
+        // Дедлайн наступил: следующее напоминание — через interval, если
+        // сессия так и будет молчать
+        const auto now = Clock::now();
+        auto it = order_.begin();
+        const int session = it->session;
+        const auto idle = now - it->last;
+        it->deadline = now + interval_;
+        order_.splice(order_.end(), order_, it);
+
+        // Колбэк может долго ходить в сеть — без блокировки таймера
+        lock.unlock();
+        cb_(session, idle);
+        lock.lock();
+    }
+}
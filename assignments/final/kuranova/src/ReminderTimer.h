@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Таймер напоминаний о бездействии.
+// У каждой сессии один дедлайн: время последней активности + interval.
+// Интервал у всех сессий общий, поэтому список, упорядоченный по времени
+// активности, упорядочен и по дедлайнам: touch() просто переносит сессию в
+// конец списка (O(1)), а ближайший дедлайн всегда в голове. Поток run() спит
+// ровно до него и не просыпается, пока напоминать некому.
+class ReminderTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+    // session — кому напомнить, idle — сколько сессия молчит
+    using Callback = std::function<void(int session, Clock::duration idle)>;
+
+    ReminderTimer(Clock::duration interval, Callback cb);
+
+    ReminderTimer(const ReminderTimer&) = delete;
+    ReminderTimer& operator=(const ReminderTimer&) = delete;
+
+    // Сессия проявила активность: взвести её таймер заново
+    void touch(int session);
+    // Больше не напоминать сессии
+    void remove(int session);
+
+    // Цикл ожидания дедлайнов, выполняется в отдельном потоке до stop()
+    void run();
+    void stop();
+
+private:
+    struct Entry {
+        int session;
+        Clock::time_point last;      // последняя активность
+        Clock::time_point deadline;  // когда напомнить
+    };
+
+    const Clock::duration interval_;
+    Callback cb_;
+
+    std::list<Entry> order_;  // по возрастанию deadline
+    std::unordered_map<int, std::list<Entry>::iterator> index_;
+    bool stop_ = false;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+};
@@ -1,5 +1,7 @@
 
 #include "AiAgent.h"
+#include "ReminderTimer.h"
+#include "TokenBudget.h"
 #include <iostream>
 #include <fstream>
 #include <queue>   
@@ -9,6 +11,11 @@
 #include <sqlite3.h>
 #include <chrono>
 #include <thread>
+#include <vector>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 using nlohmann::json;
 
@@ -27,9 +34,23 @@ int open_file(string path, string * err, string *data) {
 	}
 	
 	
+// Сообщение из истории. text указывает во внутренний буфер BD
+// и действителен до следующего вызова last_messages()
+struct MessageView {
+	std::string_view text;
+	int type;
+};
+
 class BD {
 	sqlite3* db;
 	char* err;
+	// Запросы разбираются один раз, дальше только bind/step/reset
+	sqlite3_stmt* insert_stmt = nullptr;
+	sqlite3_stmt* last_stmt = nullptr;
+	// Переиспользуемые буферы для last_messages()
+	string rows_buf;
+	std::vector<std::pair<size_t, int>> spans;
+	std::vector<MessageView> rows;
 	public:
 	BD() { //string bd_path) {
 
@@ -52,6 +73,13 @@ class BD {
 		} else {
 			//std::cout << "Таблица 'message' создана успешно!" << std::endl;
 		}
+		
+		// id — INTEGER PRIMARY KEY, т.е. сам ключ b-дерева таблицы:
+		// ORDER BY id DESC LIMIT ? читает N последних строк с конца без сортировки
+		sqlite3_prepare_v2(db, "INSERT INTO message (message_text, type) VALUES (?, ?);",
+			-1, &insert_stmt, nullptr);
+		sqlite3_prepare_v2(db, "SELECT message_text, type FROM message ORDER BY id DESC LIMIT ?;",
+			-1, &last_stmt, nullptr);
 	}
     
 		/*if (result != SQLITE_OK) {
@@ -59,68 +87,184 @@ class BD {
 		}*/
 		
 	~BD() {
+		sqlite3_finalize(insert_stmt);
+		sqlite3_finalize(last_stmt);
 		sqlite3_close(db);
 		}
 		
-	int insert_text(string data, int tp) {
-		string q = 
-        "INSERT INTO message (message_text, type) VALUES ('" + data + "', " + std::to_string(tp) + ");";
+	int insert_text(const string& data, int tp) {
+		if (!insert_stmt) {
+			std::cerr << "Ошибка вставки сообщения: " << sqlite3_errmsg(db) << std::endl;
+			return -1;
+		}
+		// Текст передаётся параметром — кавычки в сообщении больше не ломают запрос
+		sqlite3_bind_text(insert_stmt, 1, data.data(), (int)data.size(), SQLITE_STATIC);
+		sqlite3_bind_int(insert_stmt, 2, tp);
 		
-		int result = sqlite3_exec(db, q.c_str(), nullptr, nullptr, &err);
-		if (result != SQLITE_OK) {
-			std::cerr << "Ошибка вставки сообщения" << err << std::endl;
-			sqlite3_free(err);
+		int result = sqlite3_step(insert_stmt);
+		sqlite3_reset(insert_stmt);
+		sqlite3_clear_bindings(insert_stmt);
+		if (result != SQLITE_DONE) {
+			std::cerr << "Ошибка вставки сообщения: " << sqlite3_errmsg(db) << std::endl;
         return -1;
 		} 
-		//else {
-			//std::cout << "Сообщние записано" << std::endl;
-		//}
 		return 0;
 	}
-	static int callback(void* data, int argc, char ** argv, char ** colName) {
-		string* result = static_cast<string*>(data);
-		string type = (string(argv[4]) == "1") ? "user" : "system";
-		string message = argv[1];
+	
+	// Пачка сообщений одной транзакцией: один коммит журнала на всю пачку
+	int insert_batch(const std::vector<std::pair<string, int>>& batch) {
+		sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+		int rc = 0;
+		for (const auto& [text, type] : batch) {
+			if (insert_text(text, type) != 0) rc = -1;
+		}
+		sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+		return rc;
+	}
+	
+	// Последние count сообщений в хронологическом порядке
+	const std::vector<MessageView>& last_messages(int count) {
+		rows_buf.clear();
+		spans.clear();
+		rows.clear();
+		if (!last_stmt) return rows;
 		
-		if (!result->empty()) *result += ", ";
-		*result += type + ": " + message;
+		sqlite3_bind_int(last_stmt, 1, count);
+		while (sqlite3_step(last_stmt) == SQLITE_ROW) {
+			const char* text = reinterpret_cast<const char*>(sqlite3_column_text(last_stmt, 0));
+			const int len = sqlite3_column_bytes(last_stmt, 0);
+			if (text) rows_buf.append(text, len);
+			spans.emplace_back(rows_buf.size(), sqlite3_column_int(last_stmt, 1));
+		}
+		sqlite3_reset(last_stmt);
 		
-		return 0;
+		// Буфер заполнен целиком, теперь можно брать на него string_view.
+		// Строки пришли от новых к старым — разворачиваем
+		for (size_t i = spans.size(); i-- > 0;) {
+			const size_t begin = i == 0 ? 0 : spans[i - 1].first;
+			rows.push_back({std::string_view(rows_buf).substr(begin, spans[i].first - begin), spans[i].second});
+		}
+		return rows;
 	}
-	string get_lastN(int count) {
-		string result;
-		string sql = "SELECT * FROM ("
-					" SELECT * FROM message ORDER BY id DESC LIMIT " + std::to_string(count) +
-					" ) AS last_m" 
-					" ORDER BY id ASC;";
-		sqlite3_exec(db, sql.c_str(), callback, &result, NULL);
-		
-		// std::cout << "===========================================================================================================================================" +  result << std::endl;
+};
 
-		return result;
+// Дописать историю в промпт в формате "user: ..., system: ..."
+void append_history(string& out, const std::vector<MessageView>& rows) {
+	for (size_t i = 0; i < rows.size(); ++i) {
+		if (i > 0) out += ", ";
+		out += rows[i].type == 1 ? "user: " : "system: ";
+		out += rows[i].text;
 	}
-};
+}
 	
 	
 
+// mtx — только вывод в консоль, db_mtx — соединение с базой.
+// Оба держатся недолго: запросы к модели идут без блокировок
 pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t db_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 pthread_cond_t cv_in  = PTHREAD_COND_INITIALIZER;
 pthread_cond_t cv_out  = PTHREAD_COND_INITIALIZER;
-string text_path = "../text.json", prompt_path = "../prompt.json", conf_path = "../config.json";
-string err, data, tp;
+string text_path = "../text.json", conf_path = "../config.json";
+string err, tp;
 int mcount;
 
+// Шаблоны из text.json для текущего режима (tp). Файл разбирается один раз
+// при запуске, дальше промпты собираются в памяти и передаются агенту напрямую
+struct Templates {
+	string start, remember, is_end, work1, work2;
+	
+	bool load(const string& text, const string& prefix, string* err) {
+		try {
+			auto j = json::parse(text);
+			start = j.at(prefix + "start").get<std::string>();
+			remember = j.at(prefix + "remember").get<std::string>();
+			is_end = j.at(prefix + "is_end").get<std::string>();
+			work1 = j.at(prefix + "work1").get<std::string>();
+			work2 = j.at(prefix + "work2").get<std::string>();
+		} catch (const std::exception& e) {
+			if (err) *err = string("Bad templates file: ") + e.what();
+			return false;
+		}
+		return true;
+	}
+};
+Templates tpl;
+
+// Единственный писатель в базу. Потоки диалога и напоминаний только ставят
+// сообщения в очередь, а фоновый поток пишет их пачками под db_mtx
+class DbWriter {
+	BD* db;
+	std::vector<std::pair<string, int>> queue;
+	bool writing = false;
+	bool stop_flag = false;
+	std::mutex q_mtx;
+	std::condition_variable q_cv;
+	std::condition_variable idle_cv;
+	std::thread th;
+	
+	void loop() {
+		std::vector<std::pair<string, int>> batch;
+		std::unique_lock<std::mutex> lock(q_mtx);
+		while (true) {
+			q_cv.wait(lock, [this] { return stop_flag || !queue.empty(); });
+			if (queue.empty()) break;
+			batch.clear();
+			batch.swap(queue);
+			writing = true;
+			lock.unlock();
+			
+			pthread_mutex_lock(&db_mtx);
+			db->insert_batch(batch);
+			pthread_mutex_unlock(&db_mtx);
+			
+			lock.lock();
+			writing = false;
+			idle_cv.notify_all();
+		}
+	}
+	
+	public:
+	explicit DbWriter(BD* d) : db(d), th(&DbWriter::loop, this) {}
+	~DbWriter() { stop(); }
+	
+	void push(string text, int type) {
+		{
+			std::lock_guard<std::mutex> lock(q_mtx);
+			queue.emplace_back(std::move(text), type);
+		}
+		q_cv.notify_one();
+	}
+	
+	// Дождаться записи всего, что уже в очереди (перед чтением истории)
+	void drain() {
+		std::unique_lock<std::mutex> lock(q_mtx);
+		idle_cv.wait(lock, [this] { return queue.empty() && !writing; });
+	}
+	
+	// Дописать очередь и остановить поток
+	void stop() {
+		if (!th.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(q_mtx);
+			stop_flag = true;
+		}
+		q_cv.notify_all();
+		th.join();
+	}
+};
+
 
 struct Param {
-	int * is_exit;
+	std::atomic<int> * is_exit;
 	bool * is_input;
-	std::chrono::time_point<std::chrono::steady_clock> * last_time;
-	int * time;
-	int type;
+	int type;        // единица интервала: 0 — часы, 1 — минуты, иначе секунды
+	int session;
+	ReminderTimer * timer;
     AiAgent * agent;
     BD * db;
+    DbWriter * writer;
     pthread_mutex_t * mtx;
 	};
 
@@ -143,154 +287,108 @@ void in_func(void * par){
 	*/
 	
 
-void remember(string tp1, int time, string last_str) {
-	json new_j;
-	auto j = json::parse(data);
-    string work1 = j.at(tp + "remember").get<std::string>();
-    
-    new_j["prompt"] = work1 + last_str + "| последнее сообщение было " + std::to_string(time) + tp1 + " назад.";
-    std::ofstream f(prompt_path);
-    f << new_j.dump(4);
-    f.close();
+string remember(string tp1, int time, const std::vector<MessageView>& last) {
+	string prompt = tpl.remember;
+	append_history(prompt, last);
+	prompt += "| последнее сообщение было " + std::to_string(time) + tp1 + " назад.";
+	return prompt;
+	}
+
+// Запас на системное сообщение запроса и короткие вставки в промпт
+const size_t kPromptSlack = 32;
+
+// Собрать промпт по свежей истории: дописать очередь записи и коротко
+// прочитать последние сообщения под db_mtx.
+// fixed_tokens — всё, что кроме истории. Из последних mcount сообщений
+// в промпт идут самые новые, сколько влезает в окно контекста
+template <class Make>
+string with_history(Param * param, size_t fixed_tokens, Make make) {
+	const AiConfig& cfg = (*(param->agent)).config();
+	const size_t budget = historyBudget((size_t)std::max(cfg.context_tokens, 0),
+		(size_t)std::max(cfg.answer_tokens, 0), fixed_tokens + kPromptSlack);
 	
+	param->writer->drain();
+	pthread_mutex_lock(&db_mtx);
+	const auto& rows = (*(param->db)).last_messages(mcount);
+	const size_t kept = fitNewest(rows.size(), budget, [&](size_t i) {
+		return approxTokens(rows[i].text) + kMessageOverheadTokens;
+	});
+	const std::vector<MessageView> last(rows.end() - kept, rows.end());
+	string prompt = make(last);
+	pthread_mutex_unlock(&db_mtx);
+	return prompt;
+}
+
+// Напоминание по таймеру: сессия молчит idle
+void remind(Param * param, ReminderTimer::Clock::duration idle) {
+	string unit;
+	long count;
+	if (param->type == 0) {
+		unit = "часов";
+		count = std::chrono::duration_cast<std::chrono::hours>(idle).count();
+	} else if (param->type == 1) {
+		unit = "минут";
+		count = std::chrono::duration_cast<std::chrono::minutes>(idle).count();
+	} else {
+		unit = "секунд";
+		count = std::chrono::duration_cast<std::chrono::seconds>(idle).count();
 	}
+	
+	if (param->is_exit->load() == 1) return;
+	string prompt = with_history(param, approxTokens(tpl.remember), [&](const std::vector<MessageView>& last) {
+		return remember(unit, count, last);
+	});
+	
+	// Запрос к модели — без блокировок, поток ввода в это время свободен
+	string ask_err;
+	auto resp = (*(param->agent)).ask(prompt, &ask_err);
+	if (!resp) {
+		std::cerr << "Request failed: " << ask_err << "\n";
+		return;
+	}
+	if (param->is_exit->load() == 1) return;
+	
+	pthread_mutex_lock(param->mtx);
+	std::cout << endl << "<system>" << *resp << endl;
+	std::cout << "<user> ";
+	fflush(stdout);
+	pthread_mutex_unlock(param->mtx);
+	
+	param->writer->push(*resp, 1);
+}
 
+// Поток напоминаний: спит до ближайшего дедлайна таймера, без опроса
 void * out_f(void * par){
 	struct Param * param = (struct Param *)par;
-    
-	while (*(param->is_exit) != 1){
-        auto currentTime = std::chrono::steady_clock::now();
-        auto lastTime = *(param->last_time);
-        auto elapsed_h = std::chrono::duration_cast<std::chrono::hours>(currentTime - lastTime);
-		auto elapsed_m = std::chrono::duration_cast<std::chrono::minutes>(currentTime - lastTime);
-        auto elapsed_s = std::chrono::duration_cast<std::chrono::seconds>(currentTime - lastTime);
-
-		if ((param->type == 0) and (elapsed_h.count() >= *(param->time))) {
-			pthread_mutex_lock(param->mtx);
-			//std::cout << "№№№№№№№№№№№№№№DEADLOCK" << endl;
-			string last_message = (*(param->db)).get_lastN(mcount);
-			remember("часов", elapsed_h.count(), last_message);
-			if (!(*(param->agent)).loadPrompt(prompt_path, &err)) {
-				std::cerr << "Prompt error: " << err << "\n";
-				pthread_mutex_unlock(param->mtx);
-				return 0;
-			}
-			auto resp = (*(param->agent)).ask(&err);
-			if (!resp) {
-				std::cerr << "Request failed: " << err << "\n";
-				pthread_mutex_unlock(param->mtx);
-				return 0;
-			}
-			std::cout << endl << "<system>" << *resp << endl;
-			
-			*(param ->last_time) = currentTime;
-			//pthread_mutex_lock(&db_mtx);
-			(*(param->db)).insert_text(*resp, 1);
-			//pthread_mutex_unlock(&db_mtx);
-			pthread_mutex_unlock(param->mtx);
-				
-			fflush(stdout);
-		} else if ((param->type == 1) and (elapsed_m.count() >= *(param->time))) {
-			pthread_mutex_lock(param->mtx);
-			string last_message = (*(param->db)).get_lastN(mcount);
-			remember("минут", elapsed_m.count(), last_message);
-			if (!(*(param->agent)).loadPrompt(prompt_path, &err)) {
-				std::cerr << "Prompt error: " << err << "\n";
-				return 0;
-			}
-			auto resp = (*(param->agent)).ask(&err);
-			if (!resp) {
-				std::cerr << "Request failed: " << err << "\n";
-				pthread_mutex_unlock(param->mtx);
-				return 0;
-			}
-			std::cout << endl << "<system>" << *resp << endl;
-			
-			*(param ->last_time) = currentTime;
-			//std::cout << "+++++++++++++++++++++++++++++++DEADLOCK" << endl;
-			pthread_mutex_lock(&db_mtx);
-			//std::cout << "______________________________+++++++++++++++++++++++++++++++DEADLOCK" << endl;
-			(*(param->db)).insert_text(*resp, 1);
-			pthread_mutex_unlock(&db_mtx);
-			pthread_mutex_unlock(param->mtx);
-			//std::cout << "end!!!" << endl;
-			fflush(stdout);
-		} else if ((param->type > 1) and (elapsed_s.count() >= *(param->time))) {
-			pthread_mutex_lock(param->mtx);
-			//std::cout << ";;;;;;;;;;;;;;;;;;;;DEADLOCK" << endl;
-			string last_message = (*(param->db)).get_lastN(mcount);
-
-			remember("секунд", elapsed_h.count(), last_message);
-			if (!(*(param->agent)).loadPrompt(prompt_path, &err)) {
-				std::cerr << "Prompt error: " << err << "\n";
-				pthread_mutex_unlock(param->mtx);
-				return 0;
-			}
-			auto resp = (*(param->agent)).ask(&err);
-			if (!resp) {
-				std::cerr << "Request failed: " << err << "\n";
-				pthread_mutex_unlock(param->mtx);
-				return 0;
-			}
-			std::cout << endl << "<system>" << *resp << endl;
-			std::cout << "<user> ";
-			
-			*(param ->last_time) = currentTime;
-			pthread_mutex_lock(&db_mtx);
-			(*(param->db)).insert_text(*resp, 1);
-			pthread_mutex_unlock(&db_mtx);
-			pthread_mutex_unlock(param->mtx);
-				
-			fflush(stdout);
-		}
-	
-        std::this_thread::sleep_for(std::chrono::seconds(15));
-        //std::cout << "type: " << (param->type == 1) << " exit " << *(param->is_exit) << " " << (elapsed_m.count() >= *(param->time)) << " " << elapsed_m.count() << (*(param->time)) <<endl;
-		fflush(stdout);
-    }
-    
-    return 0;
+	param->timer->run();
+	return 0;
 }
 
-void write_prompt(string cur_str, string last = ""){
-	json new_j;
-	auto j = json::parse(data);
-    string work1 = j.at(tp+ "work1").get<std::string>();
-    string work2 = j.at(tp + "work2").get<std::string>();
-    string is_e = j.at(tp + "is_end").get<std::string>();
-    
-    new_j["prompt"] = work1 + last + work2 + cur_str + is_e;
-    std::ofstream f(prompt_path);
-    f << new_j.dump(4);
-    f.close();
+string write_prompt(const string& cur_str, const std::vector<MessageView>& last){
+	string prompt = tpl.work1;
+	append_history(prompt, last);
+	prompt += tpl.work2;
+	prompt += cur_str;
+	prompt += tpl.is_end;
+	return prompt;
 	}
 	
 	
-void is_end(string cur_str) {
-	json new_j;
-	auto j = json::parse(data);
-    string work1 = j.at(tp + "is_end").get<std::string>();
-    new_j["prompt"] = cur_str + "|" + work1;
-    std::ofstream f(prompt_path);
-    f << new_j.dump(4);
-    f.close();
+string is_end(const string& cur_str) {
+	return cur_str + "|" + tpl.is_end;
 	}
 
 
 
 void * func(void * par){
 	struct Param * param = (struct Param *)par;
-	auto currentTime = std::chrono::steady_clock::now();
     AiAgent * agent = param->agent;
     int is_exit = 0;
     
-	pthread_mutex_lock(param->mtx);
-	*(param->is_exit) = is_exit;
-	*(param->last_time) = currentTime;
-	pthread_mutex_unlock(param->mtx);
+	param->is_exit->store(is_exit);
+	param->timer->touch(param->session);
     
     string user_answer;
-    string last_message;
     
     //std::cout << "<user> ";
     //std::getline(std::cin, user_answer);
@@ -299,21 +397,22 @@ void * func(void * par){
     while (is_exit != 1) {
 		std::cout << "<user> ";
 		std::getline(std::cin, user_answer);
+		// Пользователь ответил — отсчёт до напоминания начинается заново
+		param->timer->touch(param->session);
 		
-		pthread_mutex_lock(param->mtx);
-		pthread_mutex_lock(&db_mtx);
-		last_message = (*(param->db)).get_lastN(mcount);
-		(*(param->db)).insert_text(user_answer, 1);
-		pthread_mutex_unlock(&db_mtx);
-		write_prompt(user_answer, last_message);
-		if (!(*agent).loadPrompt(prompt_path, &err)) {
-			std::cerr << "Prompt error: " << err << "\n";
-			return 0;
-		}
-		auto resp = (*agent).ask(&err);
+		const size_t fixed = approxTokens(tpl.work1) + approxTokens(tpl.work2)
+			+ approxTokens(user_answer) + approxTokens(tpl.is_end);
+		string prompt = with_history(param, fixed, [&](const std::vector<MessageView>& last) {
+			return write_prompt(user_answer, last);
+		});
+		param->writer->push(user_answer, 1);
+		
+		// Запрос к модели — без блокировок, напоминания не ждут ответа
+		string ask_err;
+		auto resp = (*agent).ask(prompt, &ask_err);
 		if (!resp) {
-			std::cerr << "Request failed: " << err << "\n";
-			return 0;
+			std::cerr << "Request failed: " << ask_err << "\n";
+			break;
 		}
 		string check = *resp;
 		if (tp == "") {
@@ -321,33 +420,32 @@ void * func(void * par){
 			
 			auto j = json::parse(check);
 			string txt_answr = j.at("text").get<std::string>();
-			std::cout << "<system> " << txt_answr << endl;
-
 			is_exit = j.at("flag").get<int>();
-			*(param->is_exit) = is_exit;
+			param->is_exit->store(is_exit);
+			
+			pthread_mutex_lock(param->mtx);
+			std::cout << "<system> " << txt_answr << endl;
+			fflush(stdout);
+			pthread_mutex_unlock(param->mtx);
 			if (!is_exit){
-				(*(param->db)).insert_text(txt_answr, 0);
+				param->writer->push(txt_answr, 0);
 				} 
 		}
 		else {
+			pthread_mutex_lock(param->mtx);
 			std::cout << "<system> " << check << endl;
-			(*(param->db)).insert_text(check, 0);
+			fflush(stdout);
+			pthread_mutex_unlock(param->mtx);
+			param->writer->push(check, 0);
 			
 			}
-		fflush(stdout);
-		pthread_mutex_unlock(param->mtx);
 		
 		
 		//std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!test" << endl << endl << endl;
 		/*if (tp == "") {
 			pthread_mutex_lock(param->mtx);
-			currentTime = std::chrono::steady_clock::now();
-			*(param->last_time) = currentTime;
-			is_end(user_answer);
-			if (!(*agent).loadPrompt(prompt_path, &err)) {
-				std::cerr << "Prompt error: " << err << "\n";
-				return 0;
-			}
+			param->timer->touch(param->session);
+			(*agent).setPrompt(is_end(user_answer));
 			resp = (*agent).ask(&err);
 			if (!resp) {
 				std::cerr << "Request failed: " << err << "\n";
@@ -365,7 +463,8 @@ void * func(void * par){
 		}*/
 	}
 
-	*(param->is_exit) = 1;
+	param->is_exit->store(1);
+	param->timer->remove(param->session);
 	fflush(stdout);
 	return 0;
 }
@@ -375,7 +474,6 @@ void * func(void * par){
 int main(int argc, char **argv)
 {
     AiAgent agent;
-	string cur_str;
 	BD db;
 	
 	bool is_input = false;
@@ -422,26 +520,19 @@ int main(int argc, char **argv)
     }
 
 	
+	string data;
 	if (!open_file(text_path, &err, &data)) {
 		std::cout << err;
 		return 0;
 		}
-
-	auto j = json::parse(data);
-    cur_str = j.at(tp + "start").get<std::string>();
-    json new_j;
-    new_j["prompt"] = cur_str;
-    std::ofstream f(prompt_path);
-    f << new_j.dump(4);
-    f.close();
-    
-   // std::cout << "!!!" << endl;
-    
-    
-	if (!agent.loadPrompt(prompt_path, &err)) {
-		std::cerr << "Prompt error: " << err << "\n";
+	if (!tpl.load(data, tp, &err)) {
+		std::cerr << err << "\n";
 		return 1;
-    }
+		}
+
+	// История разговора хранится в my_db.db — этого достаточно для
+	// восстановления после падения, промпт на диск больше не пишется
+    agent.setPrompt(tpl.start);
     auto resp = agent.ask(&err);
     if (!resp) {
         std::cerr << "Request failed: " << err << "\n";
@@ -453,16 +544,25 @@ int main(int argc, char **argv)
     
     pthread_t in_th, out_th;
     
-    int ex = 0;
-    auto currentTime = std::chrono::steady_clock::now();
+    std::atomic<int> ex{0};
     int tim = 5;
     struct Param m;
     m.is_exit = &ex;
     m.type = 1;
-    m.last_time = &currentTime;
-    m.time = &tim;
+    m.session = 0;
+    
+    // Напоминание через tim единиц (m.type) после последнего сообщения
+    ReminderTimer::Clock::duration interval = std::chrono::seconds(tim);
+    if (m.type == 0) interval = std::chrono::hours(tim);
+    else if (m.type == 1) interval = std::chrono::minutes(tim);
+    ReminderTimer timer(interval, [&m](int, ReminderTimer::Clock::duration idle) {
+		remind(&m, idle);
+	});
+    m.timer = &timer;
     m.agent = &agent;
     m.db = &db;
+    DbWriter writer(&db);
+    m.writer = &writer;
     m.mtx = &mtx;
     
     
@@ -473,8 +573,10 @@ int main(int argc, char **argv)
     
 	pthread_join(in_th, NULL);	
 	if (tp == "") {
+		timer.stop();
 		pthread_join(out_th, NULL);	
     }
+    writer.stop();
     
 	
 	return 0;
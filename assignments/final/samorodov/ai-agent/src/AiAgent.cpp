@@ -6,23 +6,13 @@
 #include <iostream>
 #include <algorithm>
 #include <regex>
-#include <curl/curl.h>
+#include <filesystem>
+#include <thread>
 
-#include <openssl/ssl.h>
-#include <openssl/err.h>
-#include <sys/socket.h>
-#include <netdb.h>
 #include <unistd.h>
 
 using nlohmann::json;
 
-// Callback для curl
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* response) {
-    size_t total_size = size * nmemb;
-    response->append((char*)contents, total_size);
-    return total_size;
-}
-
 // Конструктор и деструктор
 AiAgent::AiAgent() : db_(nullptr), context_enabled_(false) {
     char cwd[1024];
@@ -73,8 +63,21 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
             if (local.contains("port")) cfg_.local_port = local.at("port").get<int>();
             if (local.contains("model_path")) cfg_.local_model_path = local.at("model_path").get<std::string>();
         }
-        
-        return true;
+
+        // Кэш ответов
+        if (j.contains("cache")) {
+            auto cache = j["cache"];
+            if (cache.contains("enabled")) cfg_.cache_enabled = cache.at("enabled").get<bool>();
+            if (cache.contains("max_entries")) cfg_.cache_max_entries = cache.at("max_entries").get<size_t>();
+            if (cache.contains("max_mb")) cfg_.cache_max_mb = cache.at("max_mb").get<size_t>();
+        }
+
+        if (j.contains("prompts_path")) cfg_.prompts_path = j.at("prompts_path").get<std::string>();
+        std::filesystem::path prompts_dir(cfg_.prompts_path);
+        if (prompts_dir.is_relative()) {
+            prompts_dir = std::filesystem::path(path).parent_path() / prompts_dir;
+        }
+        return loadTemplates(prompts_dir.string(), err);
     } catch (const std::exception& e) {
         if (err) *err = std::string("Config parse error: ") + e.what();
         return false;
@@ -134,125 +137,54 @@ std::string AiAgent::detectLanguage(const std::string& code) const {
 std::string AiAgent::buildAnalysisPrompt(const std::string& code, 
                                         const std::string& language,
                                         bool is_complete_code) const {
-    std::ostringstream prompt;
-    
-    prompt << "Ты - опытный программист-аналитик. Проанализируй код и выдай результат в ЧЕТКОМ ФОРМАТЕ:\n\n";
-    
     std::string lang = language;
     if (lang == "auto") {
         lang = detectLanguage(code);
     }
-    
-    prompt << "ЯЗЫК: " << (lang == "cpp" ? "C++" : "Python") << "\n\n";
-    
-    if (is_complete_code) {
-        prompt << "ВНИМАНИЕ: Анализируй код как ЕДИНОЕ ЦЕЛОЕ, не комментируй каждую строку отдельно.\n\n";
-    }
-    
-    prompt << "ФОРМАТ ОТВЕТА (СТРОГО СОБЛЮДАЙ):\n\n";
-    prompt << "=== ОШИБКИ ===\n";
-    prompt << "1. [Тип ошибки] [Строка]: Описание\n";
-    prompt << "2. ...\n\n";
-    
-    prompt << "=== РЕКОМЕНДАЦИИ ===\n";
-    prompt << "1. [Категория]: Рекомендация\n";
-    prompt << "2. ...\n\n";
-    
-    prompt << "=== ОБЩАЯ ОЦЕНКА ===\n";
-    prompt << "[Краткая оценка качества кода, 1-2 предложения]\n\n";
-    
-    prompt << "КОД ДЛЯ АНАЛИЗА:\n```" << lang << "\n" << code << "\n```\n\n";
-    prompt << "ВАЖНО: Отвечай ТОЛЬКО в указанном формате, без лишних объяснений и без комментариев к каждой строке.";
-    
-    return prompt.str();
-}
+    const std::string_view lang_name = lang == "cpp" ? "C++" : "Python";
+    const std::string_view note = is_complete_code ? complete_note_tpl_.source() : std::string_view();
 
-// -------- Низкоуровневый HTTPS POST на /api/generate --------
-std::optional<std::string> AiAgent::httpsPostGenerate(const std::string& jsonBody, std::string* err) {
-    SSL_library_init();
-    SSL_load_error_strings();
-    OpenSSL_add_all_algorithms();
-
-    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
-    if (!ctx) { 
-        if (err) *err = "SSL_CTX_new failed"; 
-        return std::nullopt; 
-    }
-
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { 
-        if (err) *err = "socket failed"; 
-        SSL_CTX_free(ctx); 
-        return std::nullopt; 
-    }
-
-    struct addrinfo hints = {}, *res = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(cfg_.host.c_str(), cfg_.port.c_str(), &hints, &res) != 0) {
-        if (err) *err = "getaddrinfo failed";
-        close(sock); 
-        SSL_CTX_free(ctx); 
-        return std::nullopt;
-    }
-
-    if (connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
-        if (err) *err = "connect failed";
-        freeaddrinfo(res); 
-        close(sock); 
-        SSL_CTX_free(ctx); 
-        return std::nullopt;
-    }
-    freeaddrinfo(res);
+    return analysis_tpl_.render({lang_name, note, lang, code});
+}
 
-    SSL* ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, sock);
-    if (SSL_connect(ssl) <= 0) {
-        if (err) *err = "SSL_connect failed";
-        SSL_free(ssl); 
-        close(sock); 
-        SSL_CTX_free(ctx); 
-        return std::nullopt;
+bool AiAgent::loadTemplates(const std::string& dir, std::string* err) {
+    auto load = [&](PromptTemplate& dst, const char* name,
+                    std::initializer_list<std::string_view> slots) {
+        auto t = PromptTemplate::load(dir + "/" + name, slots, err);
+        if (!t) return false;
+        dst = std::move(*t);
+        return true;
+    };
+    if (!load(analysis_tpl_, "analysis.txt", {"lang_name", "complete_note", "lang", "code"}) ||
+        !load(complete_note_tpl_, "analysis_complete_note.txt", {}) ||
+        !load(batch_header_tpl_, "batch_header.txt", {"count", "marker"}) ||
+        !load(batch_file_tpl_, "batch_file.txt", {"marker", "path", "lang", "code"}) ||
+        !load(batch_footer_tpl_, "batch_footer.txt", {})) {
+        return false;
     }
 
-    // HTTP запрос
-    std::ostringstream req;
-    req << "POST /api/generate HTTP/1.1\r\n"
-        << "Host: " << cfg_.host << "\r\n"
-        << "Content-Type: application/json\r\n"
-        << "Connection: close\r\n";
-    if (!cfg_.api_key.empty()) req << "x-api-key: " << cfg_.api_key << "\r\n";
-    req << "Content-Length: " << jsonBody.size() << "\r\n\r\n"
-        << jsonBody;
-
-    const std::string request_str = req.str();
-    if (SSL_write(ssl, request_str.c_str(), (int)request_str.size()) <= 0) {
-        if (err) *err = "SSL_write failed";
-        SSL_free(ssl); 
-        close(sock); 
-        SSL_CTX_free(ctx); 
-        return std::nullopt;
+    templates_fingerprint_.clear();
+    for (const auto* t : {&analysis_tpl_, &complete_note_tpl_, &batch_header_tpl_,
+                          &batch_file_tpl_, &batch_footer_tpl_}) {
+        templates_fingerprint_ += t->source();
+        templates_fingerprint_ += '\0';
     }
+    return true;
+}
 
-    char buf[4096];
-    std::string response;
-    int bytes;
-    while ((bytes = SSL_read(ssl, buf, sizeof(buf)-1)) > 0) {
-        buf[bytes] = '\0';
-        response += buf;
-    }
+// -------- Низкоуровневый HTTPS POST на /api/generate --------
+std::optional<std::string> AiAgent::httpsPostGenerate(const std::string& jsonBody, std::string* err) {
+    std::string headers;
+    if (!cfg_.api_key.empty()) headers += "x-api-key: " + cfg_.api_key + "\r\n";
 
-    SSL_free(ssl);
-    close(sock);
-    SSL_CTX_free(ctx);
+    // Соединение берётся из пула: повторные запросы идут без нового рукопожатия
+    auto response = pool_.post(cfg_.host, cfg_.port, "/api/generate", headers, jsonBody, err);
+    if (!response) return std::nullopt;
 
     // Извлечение текста из JSON ответа
-    auto p = response.find("\r\n\r\n");
-    std::string json_part = (p != std::string::npos) ? response.substr(p + 4) : response;
-
     try {
-        auto j = json::parse(json_part);
+        const std::string_view body = response->body();
+        auto j = json::parse(body.begin(), body.end());
         if (j.contains("text")) {
             return j["text"].get<std::string>();
         }
@@ -264,17 +196,8 @@ std::optional<std::string> AiAgent::httpsPostGenerate(const std::string& jsonBod
 
 // Запрос к локальной LLM через libcurl
 std::optional<std::string> AiAgent::sendLocalRequest(const std::string& prompt, std::string* err) {
-    CURL* curl;
-    CURLcode res;
     std::string response;
-    
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    
-    if(!curl) {
-        if (err) *err = "curl_easy_init failed";
-        return std::nullopt;
-    }
+    SseStream stream(on_token_);
     
     // Формируем URL для локального сервера
     std::string url = "http://" + cfg_.local_host + ":" + 
@@ -290,40 +213,42 @@ std::optional<std::string> AiAgent::sendLocalRequest(const std::string& prompt,
         {"max_tokens", 800},
         {"temperature", 0.2},
         {"top_p", 0.9},
-        {"stream", false}
+        {"stream", static_cast<bool>(on_token_)},
+        // Шаблоны начинаются с общей для всех файлов инструкции, изменчивое
+        // (язык, код) идёт в конце: сервер берёт префикс из KV-кэша слота
+        {"cache_prompt", true}
     };
     
     std::string jsonBody = payload.dump();
     
-    // Настраиваем curl
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonBody.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonBody.size());
-    
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-    
-    // Выполняем запрос
-    res = curl_easy_perform(curl);
-    
-    // Очистка
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    
-    if(res != CURLE_OK) {
-        if (err) *err = std::string("curl_easy_perform() failed: ") + 
-                       curl_easy_strerror(res) + 
-                       " (URL: " + url + ")";
+    // Выполняем запрос через постоянный handle: соединение с сервером переиспользуется
+    bool ok;
+    if (on_token_) {
+        // Поток SSE разбираем по мере прихода, не дожидаясь конца генерации
+        ok = http_.post(url, jsonBody, SseStream::curlWrite, &stream, 60L, err);
+    } else {
+        auto body = http_.post(url, jsonBody, 60L, err);
+        ok = body.has_value();
+        if (ok) response = std::move(*body);
+    }
+    
+    if (!ok) {
+        if (err) *err += " (URL: " + url + ")";
         return std::nullopt;
     }
+
+    if (on_token_) {
+        stream.finish();
+        if (!stream.error().empty()) {
+            if (err) *err = "Server error: " + stream.error();
+            return std::nullopt;
+        }
+        if (stream.text().empty()) {
+            if (err) *err = "Unexpected response format: " + stream.raw();
+            return std::nullopt;
+        }
+        return stream.text();
+    }
     
     // Парсим JSON ответ
     try {
@@ -364,13 +289,19 @@ std::optional<std::string> AiAgent::sendRequest(const std::string& prompt, std::
     if (cfg_.inference_source == "local") {
         std::cout << "Использую локальную модель..." << std::endl;
         std::cout << "URL: http://" << cfg_.local_host << ":" << cfg_.local_port << "/v1/chat/completions" << std::endl;
-        return sendLocalRequest(prompt, err);
     } else {
         std::cout << "Использую удаленный API..." << std::endl;
-        json payload = {{"prompt", prompt}};
-        std::string body = payload.dump();
-        return httpsPostGenerate(body, err);
     }
+    return generate(prompt, err);
+}
+
+std::optional<std::string> AiAgent::generate(const std::string& prompt, std::string* err) {
+    if (cfg_.inference_source == "local") {
+        return sendLocalRequest(prompt, err);
+    }
+    json payload = {{"prompt", prompt}};
+    std::string body = payload.dump();
+    return httpsPostGenerate(body, err);
 }
 
 //МЕТОДЫ ДЛЯ РАБОТЫ С БАЗОЙ ДАННЫХ
@@ -497,6 +428,56 @@ bool AiAgent::clearSavedResponses() {
     return success;
 }
 
+//КЭШ ОТВЕТОВ
+
+bool AiAgent::ensureCache() {
+    if (!cfg_.cache_enabled) return false;
+    if (cache_.isOpen()) return true;
+
+    std::string err;
+    if (!cache_.open(db_path_, &err)) {
+        std::cerr << "Кэш ответов недоступен: " << err << std::endl;
+        cfg_.cache_enabled = false;
+        return false;
+    }
+    ResponseCache::Limits limits;
+    limits.max_entries = cfg_.cache_max_entries;
+    limits.max_bytes = cfg_.cache_max_mb * 1024 * 1024;
+    cache_.setLimits(limits);
+    return true;
+}
+
+std::string AiAgent::modelId() const {
+    if (cfg_.inference_source == "local") {
+        return "local:" + (cfg_.local_model_path.empty()
+            ? cfg_.local_host + ":" + std::to_string(cfg_.local_port)
+            : cfg_.local_model_path);
+    }
+    return "remote:" + cfg_.host;
+}
+
+std::string AiAgent::cacheKey(const std::string& code, const std::string& language, PromptKind kind) const {
+    static const char* kKindNames[] = {"full", "snippet", "batch"};
+    return ResponseCache::makeKey(code, language, kAnalysisPromptVersion,
+                                  modelId() + '\0' + templates_fingerprint_ + '\0' +
+                                  kKindNames[static_cast<int>(kind)]);
+}
+
+void AiAgent::printCacheStats() {
+    if (!ensureCache()) {
+        std::cout << "Кэш ответов выключен\n";
+        return;
+    }
+    const auto s = cache_.stats();
+    const uint64_t total = s.hits + s.misses;
+    std::cout << "=== КЭШ ОТВЕТОВ ===\n";
+    std::cout << "Записей: " << s.entries << " (" << s.bytes / 1024 << " КБ)\n";
+    std::cout << "Попаданий: " << s.hits << ", промахов: " << s.misses;
+    if (total > 0) std::cout << " (" << (s.hits * 100 / total) << "% попаданий)";
+    std::cout << "\n";
+    std::cout << "Лимиты: " << cfg_.cache_max_entries << " записей, " << cfg_.cache_max_mb << " МБ\n";
+}
+
 //ОСНОВНЫЕ МЕТОДЫ АНАЛИЗА КОДА
 
 std::optional<std::string> AiAgent::analyzeCodeFile(const std::string& filepath, 
@@ -527,8 +508,20 @@ std::optional<std::string> AiAgent::analyzeCodeString(const std::string& code,
     int line_count = std::count(code.begin(), code.end(), '\n') + 1;
     bool is_complete_code = line_count > 3;
     
-    std::string prompt = buildAnalysisPrompt(code, language, is_complete_code);
-    auto result = sendRequest(prompt, err);
+    // Неизменённый код повторно в модель не отправляем
+    const std::string lang = language == "auto" ? detectLanguage(code) : language;
+    std::string key;
+    std::optional<std::string> result;
+    if (ensureCache()) {
+        key = cacheKey(code, lang, is_complete_code ? PromptKind::Full : PromptKind::Snippet);
+        result = cache_.get(key);
+    }
+
+    if (!result) {
+        std::string prompt = buildAnalysisPrompt(code, language, is_complete_code);
+        result = sendRequest(prompt, err);
+        if (result && !key.empty()) cache_.put(key, *result);
+    }
     
     if (result && context_enabled_) {
         saveResponse(*result);
@@ -537,6 +530,216 @@ std::optional<std::string> AiAgent::analyzeCodeString(const std::string& code,
     return result;
 }
 
+//ПАКЕТНЫЙ АНАЛИЗ КАТАЛОГА
+
+namespace fs = std::filesystem;
+
+// Язык по расширению; пустая строка — файл не анализируем
+static std::string languageByExtension(const fs::path& path) {
+    static const std::vector<std::string> cpp_ext = {".cpp", ".cc", ".cxx", ".c", ".h", ".hpp", ".hh"};
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".py") return "python";
+    if (std::find(cpp_ext.begin(), cpp_ext.end(), ext) != cpp_ext.end()) return "cpp";
+    return "";
+}
+
+// Грубая оценка числа токенов: ~4 байта исходника на токен
+static size_t approxTokens(size_t bytes) {
+    return bytes / 4 + 1;
+}
+
+static const std::string kFileMarker = "### ФАЙЛ: ";
+
+// Начало строки-маркера файла path в ответе модели. Маркер должен занимать
+// строку целиком, иначе "x.c" нашёлся бы в маркере "x.cpp"
+static size_t findFileMarker(const std::string& text, const std::string& path) {
+    const std::string marker = kFileMarker + path;
+    for (size_t pos = text.find(marker); pos != std::string::npos; pos = text.find(marker, pos + 1)) {
+        const size_t after = pos + marker.size();
+        const bool line_start = pos == 0 || text[pos - 1] == '\n';
+        const bool line_end = after == text.size() || text[after] == '\n' || text[after] == '\r';
+        if (line_start && line_end) return pos;
+    }
+    return std::string::npos;
+}
+
+std::string AiAgent::buildBatchPrompt(const std::vector<SourceFile>& files) const {
+    const std::string count = std::to_string(files.size());
+
+    // Точный размер известен заранее: один буфер без перевыделений
+    size_t size = batch_header_tpl_.renderedSize({count, kFileMarker})
+                + batch_footer_tpl_.literalSize();
+    for (const auto& f : files) {
+        size += batch_file_tpl_.renderedSize({kFileMarker, f.path, f.language, f.code});
+    }
+
+    std::string prompt;
+    prompt.reserve(size);
+    batch_header_tpl_.renderTo(prompt, {count, kFileMarker});
+    for (const auto& f : files) {
+        batch_file_tpl_.renderTo(prompt, {kFileMarker, f.path, f.language, f.code});
+    }
+    batch_footer_tpl_.renderTo(prompt, {});
+    return prompt;
+}
+
+void AiAgent::analyzeBatch(std::vector<SourceFile>& batch, std::ostream& out, std::mutex& out_mtx,
+                           std::atomic<size_t>& failed) {
+    std::vector<json> lines;
+    std::vector<SourceFile> ready;
+
+    const bool cached = cache_.isOpen();
+
+    for (auto& f : batch) {
+        std::string read_err;
+        if (!readWholeFile(f.path, f.code, &read_err)) {
+            lines.push_back({{"file", f.path}, {"ok", false}, {"error", read_err}});
+            continue;
+        }
+        // Файлы, которые уже анализировались, отвечаются из кэша: годится
+        // и ответ на отдельный промпт, и раздел пакетного ответа
+        if (cached) {
+            auto hit = cache_.get(cacheKey(f.code, f.language, PromptKind::Full));
+            if (!hit) hit = cache_.get(cacheKey(f.code, f.language, PromptKind::Batch));
+            if (hit) {
+                lines.push_back({{"file", f.path}, {"language", f.language}, {"ok", true},
+                                 {"cached", true}, {"result", *hit}});
+                continue;
+            }
+        }
+        ready.push_back(std::move(f));
+    }
+
+    if (!ready.empty()) {
+        std::string err;
+        std::optional<std::string> result;
+        const PromptKind kind = ready.size() == 1 ? PromptKind::Full : PromptKind::Batch;
+        if (kind == PromptKind::Full) {
+            result = generate(buildAnalysisPrompt(ready[0].code, ready[0].language, true), &err);
+        } else {
+            result = generate(buildBatchPrompt(ready), &err);
+        }
+
+        for (size_t i = 0; i < ready.size(); ++i) {
+            const auto& f = ready[i];
+            json line = {{"file", f.path}, {"language", f.language}, {"batch_size", ready.size()}};
+            if (!result) {
+                line["ok"] = false;
+                line["error"] = err;
+                lines.push_back(line);
+                continue;
+            }
+
+            // Раздел этого файла — от его маркера до маркера следующего
+            std::string section = *result;
+            bool split = true;
+            if (ready.size() > 1) {
+                const auto begin = findFileMarker(*result, f.path);
+                if (begin != std::string::npos) {
+                    const auto body = result->find('\n', begin);
+                    const auto end = result->find(kFileMarker, begin + 1);
+                    section = body == std::string::npos ? "" : result->substr(body + 1, end - body - 1);
+                } else {
+                    // Модель не соблюла формат — отдаём ответ целиком
+                    line["split"] = false;
+                    split = false;
+                }
+            }
+            if (split && cached) cache_.put(cacheKey(f.code, f.language, kind), section);
+            line["ok"] = true;
+            line["result"] = section;
+            lines.push_back(line);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(out_mtx);
+    for (const auto& line : lines) {
+        if (!line.value("ok", false)) ++failed;
+        out << line.dump(-1, ' ', false, json::error_handler_t::replace) << "\n";
+    }
+    out.flush();
+}
+
+bool AiAgent::analyzeDirectory(const std::string& dir, const DirAnalysisOptions& opts,
+                               std::ostream& out, std::string* err) {
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec)) {
+        if (err) *err = "Каталог не найден: " + dir;
+        return false;
+    }
+
+    // Собираем исходники, пропуская скрытые каталоги и каталоги сборки
+    std::vector<SourceFile> files;
+    auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        const auto name = it->path().filename().string();
+        if (it->is_directory(ec)) {
+            if ((name.size() > 1 && name[0] == '.') || name == "build" || name.rfind("cmake-build", 0) == 0) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (!it->is_regular_file(ec)) continue;
+
+        SourceFile f;
+        f.language = languageByExtension(it->path());
+        if (f.language.empty()) continue;
+        f.size = it->file_size(ec);
+        if (ec || f.size == 0) {
+            ec.clear();
+            continue;
+        }
+        f.path = it->path().string();
+        files.push_back(std::move(f));
+    }
+    if (ec) {
+        if (err) *err = "Ошибка обхода каталога: " + ec.message();
+        return false;
+    }
+
+    std::sort(files.begin(), files.end(),
+              [](const SourceFile& a, const SourceFile& b) { return a.path < b.path; });
+
+    // Мелкие файлы склеиваем, пока суммарный объём помещается в бюджет;
+    // файл крупнее бюджета уходит отдельным запросом
+    std::vector<std::vector<SourceFile>> batches;
+    size_t batch_tokens = 0;
+    for (auto& f : files) {
+        const size_t tokens = approxTokens(f.size);
+        if (batches.empty() || batch_tokens + tokens > opts.token_budget) {
+            batches.emplace_back();
+            batch_tokens = 0;
+        }
+        batch_tokens += tokens;
+        batches.back().push_back(std::move(f));
+    }
+
+    std::cerr << "Файлов: " << files.size() << ", запросов: " << batches.size()
+              << ", потоков: " << std::max<size_t>(1, opts.jobs) << std::endl;
+
+    // Кэш открываем до старта потоков
+    ensureCache();
+
+    // Ограниченный пул: потоки по очереди забирают следующий пакет
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failed{0};
+    std::mutex out_mtx;
+    auto worker = [&]() {
+        for (size_t i; (i = next++) < batches.size();) {
+            analyzeBatch(batches[i], out, out_mtx, failed);
+        }
+    };
+
+    const size_t jobs = std::min(std::max<size_t>(1, opts.jobs), std::max<size_t>(1, batches.size()));
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < jobs; ++i) pool.emplace_back(worker);
+    for (auto& t : pool) t.join();
+
+    std::cerr << "Готово, ошибок: " << failed.load() << std::endl;
+    return true;
+}
+
 //ИНТЕРАКТИВНЫЙ РЕЖИМ
 
 void AiAgent::runInteractiveMode() {
@@ -566,6 +769,24 @@ void AiAgent::runInteractiveMode() {
     
     std::cout << "Введите код для анализа (поддерживается многострочный ввод, завершите пустой строкой):\n\n";
     
+    // Локальная модель печатает токены по мере генерации
+    bool streamed = false;
+    setTokenCallback([&streamed](const std::string& token) {
+        if (!streamed) std::cout << "\n";
+        streamed = true;
+        std::cout << token << std::flush;
+    });
+    auto printResult = [&streamed](const std::optional<std::string>& result, const std::string& err) {
+        if (result) {
+            if (!streamed) std::cout << "\n" << *result;
+            std::cout << "\n";
+        } else {
+            if (streamed) std::cout << "\n";
+            std::cout << "Ошибка: " << err << "\n";
+        }
+        streamed = false;
+    };
+
     std::string input, line;
     bool in_multiline = false;
     
@@ -593,6 +814,7 @@ void AiAgent::runInteractiveMode() {
                 std::cout << "  /local         - Переключиться на локальную модель\n";
                 std::cout << "  /remote        - Переключиться на удаленный API\n";
                 std::cout << "  /model-info    - Показать информацию о модели\n";
+                std::cout << "  /stats         - Статистика кэша ответов\n";
                 std::cout << "  /quit, /exit   - Выйти\n\n";
                 continue;
             } else if (line == "/context") {
@@ -617,6 +839,9 @@ void AiAgent::runInteractiveMode() {
             } else if (line == "/clear") {
                 clearSavedResponses();
                 continue;
+            } else if (line == "/stats") {
+                printCacheStats();
+                continue;
             } else if (line.substr(0, 6) == "/lang ") {
                 std::string lang = line.substr(6);
                 std::cout << "Язык установлен: " << lang << "\n";
@@ -625,11 +850,7 @@ void AiAgent::runInteractiveMode() {
                 std::string filepath = line.substr(6);
                 std::string err;
                 auto result = analyzeCodeFile(filepath, "auto", &err);
-                if (result) {
-                    std::cout << "\n" << *result << "\n";
-                } else {
-                    std::cout << "Ошибка: " << err << "\n";
-                }
+                printResult(result, err);
                 continue;
             } else if (line == "/local") {
                 cfg_.inference_source = "local";
@@ -652,6 +873,9 @@ void AiAgent::runInteractiveMode() {
                     std::cout << "УДАЛЕННЫЙ API" << std::endl;
                     std::cout << "Сервер: " << cfg_.host << ":" << cfg_.port << std::endl;
                 }
+                const auto tls = TlsContext::instance().stats();
+                std::cout << "TLS-рукопожатия: полных " << tls.full
+                          << ", возобновлённых " << tls.resumed << std::endl;
                 continue;
             }
         }
@@ -662,11 +886,7 @@ void AiAgent::runInteractiveMode() {
                 // Завершение многострочного ввода и анализ
                 std::string err;
                 auto result = analyzeCodeString(input, "auto", &err);
-                if (result) {
-                    std::cout << "\n" << *result << "\n";
-                } else {
-                    std::cout << "Ошибка: " << err << "\n";
-                }
+                printResult(result, err);
                 input.clear();
                 in_multiline = false;
                 std::cout << "\n";
@@ -682,14 +902,11 @@ void AiAgent::runInteractiveMode() {
                 // Однострочный ввод
                 std::string err;
                 auto result = analyzeCodeString(line, "auto", &err);
-                if (result) {
-                    std::cout << "\n" << *result << "\n";
-                } else {
-                    std::cout << "Ошибка: " << err << "\n";
-                }
+                printResult(result, err);
             }
         }
     }
     
+    setTokenCallback(nullptr);
     std::cout << "\nИнтерактивный режим завершен.\n";
 }
\ No newline at end of file
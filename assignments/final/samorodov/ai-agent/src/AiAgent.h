@@ -4,6 +4,14 @@
 #include <nlohmann/json.hpp>
 #include <sqlite3.h>
 #include <vector>
+#include <ostream>
+#include <mutex>
+#include <atomic>
+#include "HttpsPool.h"
+#include "SseStream.h"
+#include "CurlClient.h"
+#include "ResponseCache.h"
+#include "PromptTemplate.h"
 
 struct AiConfig {
     std::string inference_source = "remote"; // "remote" или "local"
@@ -14,6 +22,18 @@ struct AiConfig {
     std::string local_host = "127.0.0.1";
     int local_port = 8080;
     std::string local_model_path;
+    // Кэш ответов (таблица analysis_cache в ai_responses.db)
+    bool cache_enabled = true;
+    size_t cache_max_entries = 1000;
+    size_t cache_max_mb = 50;
+    // Каталог шаблонов промптов; относительный путь — от файла конфига
+    std::string prompts_path = "prompts";
+};
+
+// Параметры пакетного анализа каталога (analyze-dir)
+struct DirAnalysisOptions {
+    size_t jobs = 4;              // сколько запросов к модели выполняется одновременно
+    size_t token_budget = 3000;   // примерный предел токенов кода в одном запросе
 };
 
 // Структура только для сохранения ответов ИИ
@@ -42,6 +62,13 @@ public:
                                                 const std::string& language = "auto",
                                                 std::string* err = nullptr);
     
+    // Анализ всех исходников в каталоге (рекурсивно).
+    // Мелкие файлы склеиваются в общие запросы в пределах token_budget,
+    // запросы выполняются пулом из opts.jobs потоков.
+    // Результат по каждому файлу пишется в out отдельной JSON-строкой по мере готовности
+    bool analyzeDirectory(const std::string& dir, const DirAnalysisOptions& opts,
+                          std::ostream& out, std::string* err = nullptr);
+
     // Интерактивный режим анализа кода
     void runInteractiveMode();
     
@@ -50,24 +77,57 @@ public:
     bool disableContext();
     std::vector<SavedResponse> getSavedResponses() const;
     bool clearSavedResponses();
+
+    // Счётчики и размер кэша ответов
+    void printCacheStats();
     
     // Вспомогательные методы
     static bool readWholeFile(const std::string& path, std::string& out, std::string* err);
     void setPrompt(const std::string& p) { prompt_ = p; }
 
+    // Потоковый режим для локальной модели: колбэк вызывается на каждый токен
+    // по мере генерации. Пустой колбэк — обычный режим (ждём весь ответ)
+    void setTokenCallback(SseStream::TokenCallback cb) { on_token_ = std::move(cb); }
+
 private:
     // Низкоуровневые методы запросов
     std::optional<std::string> httpsPostGenerate(const std::string& jsonBody, std::string* err);
     std::optional<std::string> sendLocalRequest(const std::string& prompt, std::string* err);
     std::optional<std::string> sendRequest(const std::string& prompt, std::string* err);
+    // То же без вывода в консоль (для пакетного режима, где stdout — JSON Lines)
+    std::optional<std::string> generate(const std::string& prompt, std::string* err);
     
     // Обработка промптов
     std::string buildAnalysisPrompt(const std::string& code, 
                                    const std::string& language,
                                    bool is_complete_code = false) const;
     
+    // Пакетный промпт: несколько файлов, ответ разбит на разделы по файлам
+    struct SourceFile {
+        std::string path;
+        std::string language;
+        size_t size = 0;
+        std::string code;
+    };
+    std::string buildBatchPrompt(const std::vector<SourceFile>& files) const;
+    void analyzeBatch(std::vector<SourceFile>& batch, std::ostream& out, std::mutex& out_mtx,
+                      std::atomic<size_t>& failed);
+
     // Определение языка программирования
     std::string detectLanguage(const std::string& code) const;
+
+    // Шаблоны промптов из cfg_.prompts_path, разбираются один раз в loadConfig
+    bool loadTemplates(const std::string& dir, std::string* err);
+
+    // Кэш ответов: ключ зависит от кода, языка, вида промпта, шаблона и
+    // модели. Тексты шаблонов входят в ключ сами; версию нужно увеличить при
+    // изменении кода buildAnalysisPrompt/buildBatchPrompt
+    static constexpr int kAnalysisPromptVersion = 3;
+    // Вид промпта: ответы на разные промпты для одного кода не смешиваем
+    enum class PromptKind { Full, Snippet, Batch };
+    bool ensureCache();
+    std::string modelId() const;
+    std::string cacheKey(const std::string& code, const std::string& language, PromptKind kind) const;
     
     // Работа с SQLite (только для сохранения ответов)
     bool initResponseDatabase();
@@ -79,5 +139,19 @@ private:
     std::string prompt_;
     bool context_enabled_ = false;
     sqlite3* db_ = nullptr;
+    SseStream::TokenCallback on_token_;
     std::string db_path_ = "ai_responses.db";
+
+    // keep-alive соединения к удалённому API переживают отдельные запросы
+    HttpsPool pool_;
+
+    // Один curl-handle к локальному серверу на всё время жизни агента
+    CurlClient http_;
+
+    ResponseCache cache_;
+
+    PromptTemplate analysis_tpl_, complete_note_tpl_;
+    PromptTemplate batch_header_tpl_, batch_file_tpl_, batch_footer_tpl_;
+    // Исходники всех шаблонов — часть ключа кэша
+    std::string templates_fingerprint_;
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+#include "RecvBuffer.h"
+
+// Инкрементальный разбор ответа HTTP/1.1 из потока байт.
+// Понимает статусную строку, заголовки, Content-Length, chunked и трейлеры;
+// байты можно подавать порциями любого размера, как они пришли из сокета.
+// Тело копится в RecvBuffer; пока идёт тело, транспорт может читать
+// прямо в него (bodySpace/commitBody), минуя промежуточный буфер.
+class HttpResponseParser {
+public:
+    // Служебная строка (статус, заголовок, размер куска) длиннее этого — ошибка
+    static constexpr size_t kMaxLine = 64 * 1024;
+    // Тело больше этого — ошибка: ответ модели столько не весит
+    static constexpr size_t kMaxBody = 256 * 1024 * 1024;
+    // Сколько выделять заранее по объявленной длине; дальше буфер растёт
+    // по мере прихода данных, а не по слову сервера
+    static constexpr size_t kMaxReserve = 1024 * 1024;
+
+    // Разобрать очередную порцию. Возвращает число потреблённых байт:
+    // меньше len, только если ответ закончился или разбор завершился ошибкой
+    size_t feed(const char* data, size_t len);
+
+    // Куда читать тело напрямую: не больше room байт.
+    // nullptr — сейчас ожидаются служебные строки, данные нужно отдавать через feed()
+    char* bodySpace(size_t& room);
+    void commitBody(size_t n);
+
+    // Сервер закрыл соединение. Для ответа без длины это конец тела, иначе — ошибка
+    void onEof();
+
+    bool done() const { return state_ == State::Done; }
+    bool failed() const { return state_ == State::Error; }
+    const std::string& error() const { return error_; }
+
+    int status() const { return status_; }
+    // Можно ли после этого ответа отправить следующий запрос в то же соединение
+    bool keepAlive() const;
+    // Заголовки в порядке прихода, имена в нижнем регистре
+    const std::vector<std::pair<std::string, std::string>>& headers() const { return headers_; }
+
+    std::string_view body() const { return body_.view(); }
+    std::string takeBody() { return body_.release(); }
+
+private:
+    enum class State { StatusLine, Headers, Body, ChunkSize, ChunkData, ChunkEnd, Trailers, Done, Error };
+
+    // Накопить строку до '\n'; true — строка готова в line_ (без \r\n)
+    bool takeLine(const char*& p, const char* end);
+    void onLine();
+    void onHeadersEnd();
+    void fail(const char* what);
+
+private:
+    State state_ = State::StatusLine;
+    std::string error_;
+    std::string line_;
+
+    int status_ = 0;
+    bool http11_ = false;
+    bool conn_close_ = false;
+    bool conn_keep_alive_ = false;
+    bool chunked_ = false;
+    bool has_length_ = false;
+    size_t content_length_ = 0;
+    std::vector<std::pair<std::string, std::string>> headers_;
+
+    size_t remaining_ = 0;   // сколько байт тела (или текущего куска) ещё ждём
+    bool until_eof_ = false; // длины нет — тело идёт до закрытия соединения
+    RecvBuffer body_{0};
+};
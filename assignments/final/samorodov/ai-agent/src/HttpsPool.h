@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <optional>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <string_view>
+
+#include <openssl/ssl.h>
+#include "TlsContext.h"
+#include "HttpResponseParser.h"
+
+// Ответ HTTP: код статуса и тело.
+// Тело читается из сокета прямо в data, body() — представление без копирования
+struct HttpResponse {
+    int status = 0;
+    std::string data;
+
+    std::string_view body() const { return data; }
+};
+
+// Пул keep-alive HTTPS-соединений (HTTP/1.1).
+// Открытые соединения хранятся по ключу host:port и переиспользуются, так что
+// DNS, TCP и TLS-рукопожатие оплачиваются только на первом запросе к хосту.
+// SSL_CTX и кэш TLS-сессий общие для процесса (см. TlsContext).
+class HttpsPool {
+public:
+    HttpsPool();
+    ~HttpsPool();
+
+    HttpsPool(const HttpsPool&) = delete;
+    HttpsPool& operator=(const HttpsPool&) = delete;
+
+    // POST JSON-тела на https://host:port/path.
+    // extraHeaders — готовые строки вида "Name: value\r\n" (например, x-api-key)
+    // Возвращает std::nullopt при ошибке (описание в err, если передан)
+    std::optional<HttpResponse> post(const std::string& host, const std::string& port,
+                                     const std::string& path, const std::string& extraHeaders,
+                                     const std::string& body, std::string* err = nullptr);
+
+    // Сколько простаивающее соединение может лежать в пуле
+    void setIdleTimeout(std::chrono::seconds t) { idle_timeout_ = t; }
+
+    // Сколько простаивающих соединений держать на один host:port
+    void setMaxIdlePerHost(size_t n) { max_idle_per_host_ = n; }
+
+private:
+    struct Connection {
+        int sock = -1;
+        SSL* ssl = nullptr;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    bool openConnection(const std::string& host, const std::string& port,
+                        Connection& c, std::string* err);
+    std::optional<Connection> takeIdle(const std::string& key);
+    void putIdle(const std::string& key, Connection c);
+
+    static bool isAlive(const Connection& c);
+    static void closeConnection(Connection& c);
+
+    // Отправить запрос и прочитать один ответ.
+    // keepAlive — можно ли вернуть соединение в пул,
+    // nothingRead — сервер закрыл соединение, не прислав ни байта
+    static std::optional<HttpResponse> roundTrip(Connection& c, const std::string& request,
+                                                 bool& keepAlive, bool& nothingRead,
+                                                 std::string* err);
+
+private:
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::vector<Connection>> idle_;
+    std::chrono::seconds idle_timeout_{60};
+    size_t max_idle_per_host_ = 4;
+};
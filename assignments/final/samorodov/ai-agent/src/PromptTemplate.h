@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <initializer_list>
+
+// Шаблон промпта, разобранный один раз: литералы и слоты {{name}}.
+// Имена слотов переводятся в номера при компиляции, размер литералов
+// известен заранее, поэтому рендер — один проход memcpy в строку,
+// зарезервированную под точный размер результата.
+//
+// Значения слотов передаются в render в том же порядке, что и имена
+// в compile/load. Неизвестное имя слота в тексте — ошибка загрузки.
+class PromptTemplate {
+public:
+    using Values = std::initializer_list<std::string_view>;
+
+    PromptTemplate() = default;
+
+    static std::optional<PromptTemplate> compile(std::string_view text,
+        std::initializer_list<std::string_view> slots, std::string* err = nullptr);
+
+    // Загрузить шаблон из текстового файла (правится без пересборки)
+    static std::optional<PromptTemplate> load(const std::string& path,
+        std::initializer_list<std::string_view> slots, std::string* err = nullptr);
+
+    // Длина текста без подстановок
+    size_t literalSize() const { return literal_size_; }
+
+    // Точная длина результата для данных значений
+    size_t renderedSize(Values values) const;
+
+    // Дописать результат в out (out не очищается)
+    void renderTo(std::string& out, Values values) const;
+
+    std::string render(Values values) const;
+
+    // Исходный текст шаблона (например, для ключа кэша ответов)
+    const std::string& source() const { return source_; }
+
+private:
+    struct Segment {
+        size_t offset = 0;   // для литерала — смещение в text_
+        size_t length = 0;
+        int slot = -1;       // -1 — литерал, иначе номер слота
+    };
+
+    static std::string_view valueAt(Values values, int slot);
+
+    std::string source_;
+    std::string text_;                // все литералы подряд
+    std::vector<Segment> segments_;
+    std::vector<size_t> slot_uses_;   // сколько раз встречается каждый слот
+    size_t literal_size_ = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+// Растущий приёмный буфер для чтения из сокета.
+// Данные читаются прямо в свободное место буфера (prepare/commit),
+// без промежуточного массива на стеке и без NUL-терминатора,
+// поэтому каждый байт ответа копируется из сокета ровно один раз.
+class RecvBuffer {
+public:
+    explicit RecvBuffer(size_t initial = 16 * 1024) { buf_.resize(initial); }
+
+    // Свободное место под следующее чтение; если его нет — буфер удваивается
+    char* prepare() {
+        if (len_ == buf_.size()) buf_.resize(std::max<size_t>(buf_.size() * 2, 4096));
+        return &buf_[len_];
+    }
+    size_t available() const { return buf_.size() - len_; }
+
+    // Отметить n байт, записанных после prepare()
+    void commit(size_t n) { len_ += n; }
+
+    // Заранее выделить место под весь ответ (например, по Content-Length)
+    void reserve(size_t total) { if (buf_.size() < total) buf_.resize(total); }
+
+    // Отбросить всё после первых n байт (используется при сжатии на месте)
+    void truncate(size_t n) { if (n < len_) len_ = n; }
+
+    char* data() { return &buf_[0]; }
+    size_t size() const { return len_; }
+    std::string_view view() const { return std::string_view(buf_.data(), len_); }
+
+    // Забрать накопленные байты без копирования
+    std::string release() {
+        buf_.resize(len_);
+        len_ = 0;
+        return std::move(buf_);
+    }
+
+private:
+    std::string buf_;
+    size_t len_ = 0;
+};
@@ -0,0 +1,265 @@
+#include "ResponseCache.h"
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <openssl/evp.h>
+
+// Время обращения для LRU (микросекунды с эпохи — порядок сохраняется между запусками)
+static int64_t nowMicros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static std::string normalizeCode(const std::string& code) {
+    std::string out;
+    out.reserve(code.size());
+    std::istringstream in(code);
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto end = line.find_last_not_of(" \t\r");
+        out.append(line, 0, end == std::string::npos ? 0 : end + 1);
+        out += '\n';
+    }
+    while (!out.empty() && out.back() == '\n') out.pop_back();
+    return out;
+}
+
+ResponseCache::~ResponseCache() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!db_) return;
+    flush();
+    finalizeStatements();
+    sqlite3_close(db_);
+}
+
+bool ResponseCache::open(const std::string& dbPath, std::string* err) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (db_) return true;
+
+    if (sqlite3_open(dbPath.c_str(), &db_) != SQLITE_OK) {
+        if (err) *err = sqlite3_errmsg(db_);
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+    // Параллельные процессы analyze-dir не должны падать на занятой базе
+    sqlite3_busy_timeout(db_, 2000);
+
+    const char* sql =
+        "CREATE TABLE IF NOT EXISTS analysis_cache ("
+        "key TEXT PRIMARY KEY,"
+        "response TEXT NOT NULL,"
+        "size INTEGER NOT NULL,"
+        "last_used INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_analysis_cache_last_used ON analysis_cache(last_used);"
+        "CREATE TABLE IF NOT EXISTS cache_stats ("
+        "name TEXT PRIMARY KEY,"
+        "value INTEGER NOT NULL"
+        ");"
+        "INSERT OR IGNORE INTO cache_stats (name, value) VALUES ('hits', 0), ('misses', 0);";
+
+    char* err_msg = nullptr;
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        if (err) *err = err_msg ? err_msg : "SQL error";
+        sqlite3_free(err_msg);
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+    if (!prepareStatements(err)) {
+        finalizeStatements();
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+
+    // Единственный полный проход по таблице; дальше размер ведётся в памяти
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT COUNT(*), COALESCE(SUM(size), 0) FROM analysis_cache;",
+                           -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            entries_ = (size_t)sqlite3_column_int64(stmt, 0);
+            bytes_ = (size_t)sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return true;
+}
+
+bool ResponseCache::prepareStatements(std::string* err) {
+    const std::pair<sqlite3_stmt**, const char*> statements[] = {
+        {&select_, "SELECT response FROM analysis_cache WHERE key = ?;"},
+        {&size_of_, "SELECT size FROM analysis_cache WHERE key = ?;"},
+        {&insert_, "INSERT OR REPLACE INTO analysis_cache (key, response, size, last_used) VALUES (?, ?, ?, ?);"},
+        {&touch_, "UPDATE analysis_cache SET last_used = MAX(last_used, ?) WHERE key = ?;"},
+        {&add_counter_, "UPDATE cache_stats SET value = value + ? WHERE name = ?;"},
+        {&oldest_, "SELECT key, size FROM analysis_cache ORDER BY last_used ASC;"},
+        {&delete_, "DELETE FROM analysis_cache WHERE key = ?;"},
+    };
+    for (const auto& [stmt, sql] : statements) {
+        if (sqlite3_prepare_v2(db_, sql, -1, stmt, nullptr) != SQLITE_OK) {
+            if (err) *err = sqlite3_errmsg(db_);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ResponseCache::finalizeStatements() {
+    for (sqlite3_stmt** stmt : {&select_, &size_of_, &insert_, &touch_, &add_counter_, &oldest_, &delete_}) {
+        sqlite3_finalize(*stmt);
+        *stmt = nullptr;
+    }
+}
+
+std::string ResponseCache::makeKey(const std::string& code, const std::string& language,
+                                   int promptVersion, const std::string& modelId) {
+    // Поля разделяем нулевым байтом, чтобы "ab"+"c" не совпало с "a"+"bc"
+    std::string material = normalizeCode(code);
+    material += '\0';
+    material += language;
+    material += '\0';
+    material += std::to_string(promptVersion);
+    material += '\0';
+    material += modelId;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_Digest(material.data(), material.size(), digest, &len, EVP_sha256(), nullptr);
+
+    std::ostringstream hex;
+    for (unsigned int i = 0; i < len; ++i) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(digest[i]);
+    }
+    return hex.str();
+}
+
+std::optional<std::string> ResponseCache::get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!db_) return std::nullopt;
+
+    std::optional<std::string> result;
+    sqlite3_bind_text(select_, 1, key.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(select_) == SQLITE_ROW) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(select_, 0));
+        result = std::string(text ? text : "", sqlite3_column_bytes(select_, 0));
+    }
+    sqlite3_reset(select_);
+    sqlite3_clear_bindings(select_);
+
+    if (result) {
+        ++pending_hits_;
+        touched_[key] = nowMicros();
+    } else {
+        ++pending_misses_;
+    }
+    if (pending_hits_ + pending_misses_ >= kFlushEvery) flush();
+    return result;
+}
+
+void ResponseCache::flushPending() {
+    for (const auto& [key, last_used] : touched_) {
+        sqlite3_bind_int64(touch_, 1, last_used);
+        sqlite3_bind_text(touch_, 2, key.c_str(), -1, SQLITE_STATIC);
+        sqlite3_step(touch_);
+        sqlite3_reset(touch_);
+    }
+    sqlite3_clear_bindings(touch_);
+
+    const std::pair<const char*, uint64_t> counters[] = {{"hits", pending_hits_}, {"misses", pending_misses_}};
+    for (const auto& [name, value] : counters) {
+        if (value == 0) continue;
+        sqlite3_bind_int64(add_counter_, 1, (sqlite3_int64)value);
+        sqlite3_bind_text(add_counter_, 2, name, -1, SQLITE_STATIC);
+        sqlite3_step(add_counter_);
+        sqlite3_reset(add_counter_);
+    }
+    sqlite3_clear_bindings(add_counter_);
+
+    touched_.clear();
+    pending_hits_ = pending_misses_ = 0;
+}
+
+void ResponseCache::flush() {
+    if (touched_.empty() && pending_hits_ == 0 && pending_misses_ == 0) return;
+    sqlite3_exec(db_, "BEGIN;", nullptr, nullptr, nullptr);
+    flushPending();
+    sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+void ResponseCache::put(const std::string& key, const std::string& response) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!db_) return;
+
+    // Ответ больше всего кэша хранить бессмысленно
+    if (response.size() > limits_.max_bytes) return;
+
+    sqlite3_exec(db_, "BEGIN;", nullptr, nullptr, nullptr);
+
+    // Замена записи не меняет их число, но меняет суммарный размер
+    sqlite3_bind_text(size_of_, 1, key.c_str(), -1, SQLITE_STATIC);
+    const bool replaced = sqlite3_step(size_of_) == SQLITE_ROW;
+    const size_t old_size = replaced ? (size_t)sqlite3_column_int64(size_of_, 0) : 0;
+    sqlite3_reset(size_of_);
+    sqlite3_clear_bindings(size_of_);
+
+    sqlite3_bind_text(insert_, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(insert_, 2, response.data(), (int)response.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(insert_, 3, (sqlite3_int64)response.size());
+    sqlite3_bind_int64(insert_, 4, nowMicros());
+    if (sqlite3_step(insert_) == SQLITE_DONE) {
+        if (!replaced) ++entries_;
+        bytes_ = bytes_ - std::min(bytes_, old_size) + response.size();
+    }
+    sqlite3_reset(insert_);
+    sqlite3_clear_bindings(insert_);
+    touched_.erase(key);
+
+    // Время обращений нужно LRU до вытеснения
+    flushPending();
+    evict();
+
+    sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+void ResponseCache::evict() {
+    if (entries_ <= limits_.max_entries && bytes_ <= limits_.max_bytes) return;
+
+    // Удаляем самые давно использованные, пока не уложимся в оба лимита
+    while ((entries_ > limits_.max_entries || bytes_ > limits_.max_bytes) &&
+           sqlite3_step(oldest_) == SQLITE_ROW) {
+        sqlite3_bind_text(delete_, 1, reinterpret_cast<const char*>(sqlite3_column_text(oldest_, 0)), -1,
+                          SQLITE_TRANSIENT);
+        sqlite3_step(delete_);
+        sqlite3_reset(delete_);
+        if (sqlite3_changes(db_) > 0) {
+            --entries_;
+            bytes_ -= std::min(bytes_, (size_t)sqlite3_column_int64(oldest_, 1));
+        }
+    }
+    sqlite3_clear_bindings(delete_);
+    sqlite3_reset(oldest_);
+}
+
+ResponseCache::Stats ResponseCache::stats() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Stats s;
+    if (!db_) return s;
+
+    flush();
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT name, value FROM cache_stats;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            if (name == "hits") s.hits = sqlite3_column_int64(stmt, 1);
+            else if (name == "misses") s.misses = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+    s.entries = entries_;
+    s.bytes = bytes_;
+    return s;
+}
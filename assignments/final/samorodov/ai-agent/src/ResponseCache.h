@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <optional>
+#include <mutex>
+#include <cstdint>
+#include <unordered_map>
+#include <sqlite3.h>
+
+// Постоянный кэш ответов модели в SQLite (таблица analysis_cache в ai_responses.db).
+// Ключ — SHA-256 от нормализованного кода, языка, версии шаблона промпта и модели,
+// так что неизменённый файл повторно не уходит в модель.
+// Вытеснение LRU по времени последнего обращения при превышении лимитов.
+//
+// Поиск только читает базу. Счётчики попаданий и время обращения копятся
+// в памяти и пишутся пачкой: каждые kFlushEvery обращений, при put,
+// stats и закрытии. Число записей и их размер ведутся в памяти, без
+// пересчёта по таблице; запись из другого процесса учтётся при следующем open.
+class ResponseCache {
+public:
+    struct Limits {
+        size_t max_entries = 1000;
+        size_t max_bytes = 50 * 1024 * 1024;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    ResponseCache() = default;
+    ~ResponseCache();
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    // Открыть (создать) таблицы кэша в файле базы
+    bool open(const std::string& dbPath, std::string* err = nullptr);
+    void setLimits(const Limits& limits) { limits_ = limits; }
+    bool isOpen() const { return db_ != nullptr; }
+
+    // Ключ кэша; код нормализуется (CRLF, хвостовые пробелы, пустые строки в конце)
+    static std::string makeKey(const std::string& code, const std::string& language,
+                               int promptVersion, const std::string& modelId);
+
+    // Найти ответ; попадание отмечается в памяти, база не пишется
+    std::optional<std::string> get(const std::string& key);
+    // Сохранить ответ и при необходимости вытеснить самые старые записи
+    void put(const std::string& key, const std::string& response);
+
+    Stats stats();
+
+private:
+    static constexpr size_t kFlushEvery = 64;
+
+    // Подготовленные запросы живут, пока открыта база
+    bool prepareStatements(std::string* err);
+    void finalizeStatements();
+    // Записать накопленные обращения; вызывается внутри транзакции
+    void flushPending();
+    // То же в отдельной транзакции
+    void flush();
+    void evict();
+
+private:
+    std::mutex mtx_;
+    sqlite3* db_ = nullptr;
+    Limits limits_;
+
+    sqlite3_stmt* select_ = nullptr;
+    sqlite3_stmt* size_of_ = nullptr;
+    sqlite3_stmt* insert_ = nullptr;
+    sqlite3_stmt* touch_ = nullptr;
+    sqlite3_stmt* add_counter_ = nullptr;
+    sqlite3_stmt* oldest_ = nullptr;
+    sqlite3_stmt* delete_ = nullptr;
+
+    // Ещё не записанные в базу обращения
+    uint64_t pending_hits_ = 0;
+    uint64_t pending_misses_ = 0;
+    std::unordered_map<std::string, int64_t> touched_;   // ключ -> last_used
+
+    size_t entries_ = 0;
+    size_t bytes_ = 0;
+};
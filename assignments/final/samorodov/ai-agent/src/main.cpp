@@ -1,6 +1,9 @@
 #include "AiAgent.h"
 #include <iostream>
 #include <filesystem>
+#include <fstream>
+#include <charconv>
+#include <cstring>
 
 namespace fs = std::filesystem;
 
@@ -9,18 +12,25 @@ void printUsage() {
     std::cout << "Использование:\n";
     std::cout << "  ./ai_agent analyze <файл> [язык]   - Анализ файла\n";
     std::cout << "  ./ai_agent code \"<код>\" [язык]     - Анализ кода из строки\n";
+    std::cout << "  ./ai_agent analyze-dir <каталог> [--jobs N] [--budget N] [--out файл]\n";
+    std::cout << "                                     - Анализ всех исходников каталога (JSON Lines)\n";
     std::cout << "  ./ai_agent interactive             - Интерактивный режим\n";
     std::cout << "  ./ai_agent saved                   - Показать сохраненные ответы\n";
     std::cout << "  ./ai_agent clear                   - Очистить сохраненные ответы\n";
+    std::cout << "  ./ai_agent stats                   - Статистика кэша ответов\n";
     std::cout << "  ./ai_agent help                    - Показать справку\n\n";
     
     std::cout << "Параметры:\n";
-    std::cout << "  язык: cpp, python, auto (определить автоматически)\n\n";
+    std::cout << "  язык: cpp, python, auto (определить автоматически)\n";
+    std::cout << "  --jobs N    одновременных запросов к модели (по умолчанию 4)\n";
+    std::cout << "  --budget N  примерный предел токенов кода в одном запросе (по умолчанию 3000)\n";
+    std::cout << "  --out файл  куда писать результаты (по умолчанию stdout)\n\n";
     
     std::cout << "Примеры:\n";
     std::cout << "  ./ai_agent analyze main.cpp\n";
     std::cout << "  ./ai_agent analyze script.py python\n";
     std::cout << "  ./ai_agent code \"def test(): return 1\" python\n";
+    std::cout << "  ./ai_agent analyze-dir src --jobs 8 --out report.jsonl\n";
     std::cout << "  ./ai_agent interactive\n";
 }
 
@@ -28,6 +38,15 @@ bool fileExists(const std::string& path) {
     return fs::exists(path);
 }
 
+// Положительное целое без мусора в конце; иначе nullopt
+std::optional<size_t> parsePositive(const char* s) {
+    size_t value = 0;
+    const char* end = s + std::strlen(s);
+    auto [ptr, ec] = std::from_chars(s, end, value);
+    if (ec != std::errc() || ptr != end || value == 0) return std::nullopt;
+    return value;
+}
+
 int main(int argc, char* argv[]) {
     AiAgent agent;
     
@@ -85,6 +104,47 @@ int main(int argc, char* argv[]) {
         
         std::cout << *result << "\n";
         
+    } else if (command == "analyze-dir" && argc >= 3) {
+        std::string dir = argv[2];
+        DirAnalysisOptions opts;
+        std::string out_path;
+
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Не указано значение для " << arg << "\n";
+                return 1;
+            }
+            if (arg == "--jobs" || arg == "--budget") {
+                auto value = parsePositive(argv[++i]);
+                if (!value) {
+                    std::cerr << "Некорректное значение " << arg << ": " << argv[i] << "\n\n";
+                    printUsage();
+                    return 1;
+                }
+                (arg == "--jobs" ? opts.jobs : opts.token_budget) = *value;
+            } else if (arg == "--out") {
+                out_path = argv[++i];
+            } else {
+                std::cerr << "Неизвестный параметр: " << arg << "\n";
+                return 1;
+            }
+        }
+
+        std::ofstream out_file;
+        if (!out_path.empty()) {
+            out_file.open(out_path);
+            if (!out_file) {
+                std::cerr << "Не удалось открыть " << out_path << "\n";
+                return 1;
+            }
+        }
+
+        if (!agent.analyzeDirectory(dir, opts, out_path.empty() ? std::cout : out_file, &err)) {
+            std::cerr << "Ошибка анализа: " << err << "\n";
+            return 1;
+        }
+
     } else if (command == "code" && argc >= 3) {
         std::string code = argv[2];
         std::string language = (argc >= 4) ? argv[3] : "auto";
@@ -119,6 +179,9 @@ int main(int argc, char* argv[]) {
             std::cout << "✗ Ошибка очистки\n";
         }
         
+    } else if (command == "stats") {
+        agent.printCacheStats();
+        
     } else if (command == "help" || command == "--help" || command == "-h") {
         printUsage();
         
@@ -0,0 +1,179 @@
+// Фаззинг HttpResponseParser.
+//
+// Один и тот же вход разбирается тремя способами: целиком, порциями
+// случайной длины и так, как читает HttpsPool (тело — через
+// bodySpace/commitBody). Результаты обязаны совпасть, а разбор — не бросать
+// исключений и не падать.
+//
+// Без libFuzzer это самостоятельная программа: мутирует набор затравок
+// заданное число раз или прогоняет файлы из аргументов:
+//   http_parser_fuzz [итераций]        http_parser_fuzz файл...
+// С -DAI_AGENT_LIBFUZZER=ON (clang) собирается как цель libFuzzer.
+#include "HttpResponseParser.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Outcome {
+    bool done = false;
+    bool failed = false;
+    int status = 0;
+    std::string body;
+};
+
+Outcome finish(HttpResponseParser& parser) {
+    parser.onEof();
+    Outcome out;
+    out.done = parser.done();
+    out.failed = parser.failed();
+    out.status = parser.status();
+    if (out.done) out.body = std::string(parser.body());
+    return out;
+}
+
+// Всё одним вызовом feed
+Outcome parseWhole(const uint8_t* data, size_t size) {
+    HttpResponseParser parser;
+    parser.feed(reinterpret_cast<const char*>(data), size);
+    return finish(parser);
+}
+
+// Порциями, длины которых берутся из самого входа
+Outcome parseSplit(const uint8_t* data, size_t size) {
+    HttpResponseParser parser;
+    size_t pos = 0, k = 0;
+    while (pos < size && !parser.done() && !parser.failed()) {
+        const size_t n = std::min<size_t>(size - pos, 1 + data[k++ % size] % 7);
+        parser.feed(reinterpret_cast<const char*>(data + pos), n);
+        pos += n;
+    }
+    return finish(parser);
+}
+
+// Как HttpsPool::roundTrip: тело читается прямо в буфер парсера
+Outcome parseDirect(const uint8_t* data, size_t size) {
+    HttpResponseParser parser;
+    size_t pos = 0;
+    while (pos < size && !parser.done() && !parser.failed()) {
+        size_t room = 0;
+        if (char* dst = parser.bodySpace(room)) {
+            const size_t n = std::min(room, size - pos);
+            if (n == 0) break;
+            std::memcpy(dst, data + pos, n);
+            parser.commitBody(n);
+            pos += n;
+        } else {
+            const size_t n = std::min<size_t>(size - pos, 13);
+            const size_t used = parser.feed(reinterpret_cast<const char*>(data + pos), n);
+            pos += used;
+            if (used < n) break;
+        }
+    }
+    return finish(parser);
+}
+
+bool same(const Outcome& a, const Outcome& b) {
+    return a.done == b.done && a.failed == b.failed && a.status == b.status && a.body == b.body;
+}
+
+void check(const uint8_t* data, size_t size) {
+    const Outcome whole = parseWhole(data, size);
+    if (size == 0) return;
+    const Outcome split = parseSplit(data, size);
+    const Outcome direct = parseDirect(data, size);
+    if (!same(whole, split) || !same(whole, direct)) {
+        std::fprintf(stderr, "mismatch: whole done=%d failed=%d, split done=%d failed=%d, "
+                             "direct done=%d failed=%d\n",
+                     whole.done, whole.failed, split.done, split.failed, direct.done, direct.failed);
+        std::fwrite(data, 1, size, stderr);
+        std::abort();
+    }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    check(data, size);
+    return 0;
+}
+
+#ifndef AI_AGENT_LIBFUZZER
+namespace {
+
+const char* kSeeds[] = {
+    "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-T: 1\r\n\r\n",
+    "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok",
+    "HTTP/1.0 200 OK\r\n\r\nbody until eof",
+    "HTTP/1.1 204 No Content\r\n\r\n",
+    "HTTP/1.1 200 OK\r\nContent-Length: 99999999999\r\n\r\nx",
+    "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nfffffffffff\r\nx",
+};
+
+// Ответы, которые разбор обязан отклонить, а не упасть на выделении памяти
+void checkLimits() {
+    const char* huge[] = {kSeeds[5], kSeeds[6]};
+    for (const char* s : huge) {
+        HttpResponseParser parser;
+        parser.feed(s, std::strlen(s));
+        if (!parser.failed()) {
+            std::fprintf(stderr, "huge length accepted: %s\n", s);
+            std::abort();
+        }
+    }
+}
+
+std::string mutate(std::string s, std::mt19937& rng) {
+    static const char kAlphabet[] = "0123456789abcdefABCDEF \t\r\n:;-HTTP/1.";
+    const int edits = 1 + rng() % 4;
+    for (int i = 0; i < edits; ++i) {
+        const size_t pos = s.empty() ? 0 : rng() % s.size();
+        switch (rng() % 5) {
+        case 0: if (!s.empty()) s[pos] = static_cast<char>(rng()); break;
+        case 1: s.insert(s.begin() + pos, kAlphabet[rng() % (sizeof(kAlphabet) - 1)]); break;
+        case 2: if (!s.empty()) s.erase(pos, 1 + rng() % 8); break;
+        case 3: s.insert(pos, s.substr(rng() % (s.size() + 1), rng() % 16)); break;
+        default: s.resize(pos); break;
+        }
+    }
+    return s;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    checkLimits();
+
+    // Файлы — прогнать как есть (например, найденные ранее входы)
+    if (argc > 1 && std::strtoul(argv[1], nullptr, 10) == 0) {
+        for (int i = 1; i < argc; ++i) {
+            std::ifstream in(argv[i], std::ios::binary);
+            const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            check(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        }
+        std::printf("%d file(s) ok\n", argc - 1);
+        return 0;
+    }
+
+    const unsigned long iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    std::mt19937 rng(12345);
+    for (const char* seed : kSeeds) {
+        check(reinterpret_cast<const uint8_t*>(seed), std::strlen(seed));
+    }
+    for (unsigned long i = 0; i < iterations; ++i) {
+        const std::string input = mutate(kSeeds[rng() % std::size(kSeeds)], rng);
+        check(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    }
+    std::printf("%lu iteration(s) ok\n", iterations);
+    return 0;
+}
+#endif
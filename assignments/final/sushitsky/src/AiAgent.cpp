@@ -1,19 +1,19 @@
 #include "AiAgent.h"
+#include "TokenBudget.h"
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <cctype>
+#include <csignal>
+#include <charconv>
+#include <filesystem>
 
 #include <iostream> //CLI
 #include <algorithm> //CLI
 
-#include <openssl/ssl.h>
-#include <openssl/err.h>
-#include <sys/socket.h>
-#include <netdb.h>
 #include <unistd.h>
 
-#include "curl/curl.h"
 
 using nlohmann::json;
 
@@ -22,7 +22,6 @@ AiAgent::AiAgent() {
 #ifdef NO_SQLITE
     context_enabled_ = false;
 #else
-    db_ = nullptr;
     context_enabled_ = false;
     
     // Устанавливаем абсолютный путь к базе данных в текущей директории
@@ -37,7 +36,9 @@ AiAgent::AiAgent() {
 }
 
 AiAgent::~AiAgent() {
-    closeDatabase();
+    saveKvSnapshot();
+    // Дописываем на диск всё, что ещё стоит в очереди
+    context_.close();
 }
 
 // --------- utils IO ----------
@@ -67,6 +68,21 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
         if (j.contains("local_http_port")) cfg_.local_http_port = j.at("local_http_port").get<std::string>();
         if (j.contains("local_model_path")) cfg_.local_model_path = j.at("local_model_path").get<std::string>();
         if (j.contains("local_model_n_ctx")) cfg_.local_model_n_ctx = j.at("local_model_n_ctx").get<int>();
+        if (j.contains("answer_tokens")) cfg_.answer_tokens = j.at("answer_tokens").get<int>();
+        if (j.contains("local_slot_id")) cfg_.local_slot_id = j.at("local_slot_id").get<int>();
+        if (j.contains("local_threads")) cfg_.local_threads = j.at("local_threads").get<int>();
+        if (j.contains("kv_cache_dir")) cfg_.kv_cache_dir = j.at("kv_cache_dir").get<std::string>();
+        if (j.contains("route_failover")) cfg_.route_failover = j.at("route_failover").get<bool>();
+        if (j.contains("route_hedge")) cfg_.route_hedge = j.at("route_hedge").get<bool>();
+        if (j.contains("route_hedge_ms")) cfg_.route_hedge_ms = j.at("route_hedge_ms").get<int>();
+        if (j.contains("route_prefer_fastest")) cfg_.route_prefer_fastest = j.at("route_prefer_fastest").get<bool>();
+
+        BackendRouter::Options route;
+        route.failover = cfg_.route_failover;
+        route.hedge = cfg_.route_hedge;
+        route.prefer_fastest = cfg_.route_prefer_fastest;
+        route.hedge_default = std::chrono::milliseconds(cfg_.route_hedge_ms);
+        router_.setOptions(route);
 
         return true;
     } catch (const std::exception& e) {
@@ -97,13 +113,13 @@ bool AiAgent::loadPrompt(const std::string& path, std::string* err) {
 }
 
 // ------- Простейший разбор JSON: ожидаем { "text": "<строка>" } -------
-std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
-    // Если вместе с HTTP-хедерами — отрежем их
+std::string AiAgent::extractTextFromJsonBody(std::string_view body) {
+    // Если вместе с HTTP-хедерами — отрежем их (без копирования тела)
     const auto p = body.find("\r\n\r\n");
-    const std::string json_part = (p != std::string::npos) ? body.substr(p + 4) : body;
+    if (p != std::string_view::npos) body.remove_prefix(p + 4);
 
     try {
-        auto j = json::parse(json_part);
+        auto j = json::parse(body.begin(), body.end());
         return j.at("text").get<std::string>();  // строго ожидаем поле "text"
     } catch (...) {
         return {};
@@ -112,69 +128,17 @@ std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
 
 // -------- Низкоуровневый HTTPS POST на /api/generate --------
 std::optional<std::string> AiAgent::httpsPostGenerate(
-        const AiConfig& cfg, const std::string& jsonBody, std::string* err) {
-    SSL_library_init();
-    SSL_load_error_strings();
-    OpenSSL_add_all_algorithms();
+        const AiConfig& cfg, const std::string& jsonBody, std::string* err,
+        const std::atomic<bool>* abort) const {
+    std::string headers;
+    if (!cfg.api_key.empty()) headers += "x-api-key: " + cfg.api_key + "\r\n";
 
-    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
-    if (!ctx) { if (err) *err = "SSL_CTX_new failed"; return std::nullopt; }
-
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { if (err) *err = "socket failed"; SSL_CTX_free(ctx); return std::nullopt; }
-
-    struct addrinfo hints = {}, *res = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &res) != 0) {
-        if (err) *err = "getaddrinfo failed";
-        close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    if (connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
-        if (err) *err = "connect failed";
-        freeaddrinfo(res); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-    freeaddrinfo(res);
-
-    SSL* ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, sock);
-    if (SSL_connect(ssl) <= 0) {
-        if (err) *err = "SSL_connect failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    // HTTP запрос
-    std::ostringstream req;
-    req << "POST /api/generate HTTP/1.1\r\n"
-        << "Host: " << cfg.host << "\r\n"
-        << "Content-Type: application/json\r\n"
-        << "Connection: close\r\n";
-    if (!cfg.api_key.empty()) req << "x-api-key: " << cfg.api_key << "\r\n";
-    req << "Content-Length: " << jsonBody.size() << "\r\n\r\n"
-        << jsonBody;
-
-    const std::string request_str = req.str();
-    if (SSL_write(ssl, request_str.c_str(), (int)request_str.size()) <= 0) {
-        if (err) *err = "SSL_write failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    char buf[4096];
-    std::string response;
-    int bytes;
-    while ((bytes = SSL_read(ssl, buf, sizeof(buf)-1)) > 0) {
-        buf[bytes] = '\0';
-        response += buf;
-    }
-
-    SSL_free(ssl);
-    close(sock);
-    SSL_CTX_free(ctx);
+    // Соединение берётся из пула: повторные запросы идут без нового рукопожатия
+    auto response = pool_.post(cfg.host, cfg.port, "/api/generate", headers, jsonBody, err, abort);
+    if (!response) return std::nullopt;
 
     // ----- Используем nlohmann::json для извлечения "text" -----
-    std::string text = extractTextFromJsonBody(response);
+    std::string text = extractTextFromJsonBody(response->body());
     if (text.empty()) {
         if (err) *err = "Cannot extract \"text\" from JSON response";
         return std::nullopt;
@@ -182,101 +146,245 @@ std::optional<std::string> AiAgent::httpsPostGenerate(
     return text;
 }
 
-std::optional<std::string> AiAgent::ask(std::string* outErr) const {
+// Базовый системный промпт локальной модели
+static const char* kSystemPrompt = "Ты — полезный AI-ассистент. Отвечай кратко и информативно.";
+
+// Промпт, заданный строкой: базовый системный промпт + пользовательский запрос
+static PromptLayout singleTurn(const std::string& prompt) {
+    PromptLayout layout;
+    layout.add(PromptLayout::Tier::System, kSystemPrompt);
+    layout.add(PromptLayout::Tier::Input, prompt);
+    return layout;
+}
+
+std::optional<std::string> AiAgent::ask(std::string* outErr, const std::atomic<bool>* cancel) const {
     if (prompt_.empty()) {
         if (outErr) *outErr = "Prompt is empty (load it first)";
         return std::nullopt;
     }
 
-    // РАЗНЫЕ ФОРМАТЫ ДЛЯ РАЗНЫХ ТИПОВ МОДЕЛЕЙ
-    std::string body;
-    
-    if (cfg_.model_type == "local_http") {
-        // Формат OpenAI API для локального сервера
-        json messages;
-        
-        // Базовый системный промпт + пользовательский запрос
-        std::string system_prompt = "Ты — полезный AI-ассистент. Отвечай кратко и информативно.";
-        messages.push_back({{"role", "system"}, {"content", system_prompt}});
-        messages.push_back({{"role", "user"}, {"content", prompt_}});
-        
-        json payload = {
-            {"model", "local-gguf"},
-            {"messages", messages},
-            {"max_tokens", 500},
-            {"temperature", 0.7},
-            {"top_p", 0.9}
+    if (cfg_.model_type == "local_lib") {
+        auto text = libGenerate(layout_.empty() ? singleTurn(prompt_) : layout_, outErr, on_token_, cancel);
+        if (text) {
+            std::lock_guard<std::mutex> lock(kv_mtx_);
+            kv_lib_.dirty = true;
+        }
+        return text;
+    }
+
+    // remote и local_http: бэкенд выбирает маршрутизатор. Вызовы могут
+    // пережить ask() (проигравший гонку запрос дорабатывает в фоне),
+    // поэтому тела запросов захватываются по значению
+    std::vector<BackendRouter::Call> calls(2);
+    if (!cfg_.host.empty()) {
+        calls[kRouteRemote] = [this, body = json{ {"prompt", prompt_} }.dump()](
+                const BackendRouter::TokenCallback&, const std::atomic<bool>& abort, std::string* err) {
+            return httpsPostGenerate(cfg_, body, err, &abort);
         };
-        
-        body = payload.dump();
-        return localHttpPostGenerate(cfg_, body, outErr);
-        
-    } else {
-        // Оригинальный формат для удаленного API
-        json payload = { {"prompt", prompt_} };
-        body = payload.dump();
-        return httpsPostGenerate(cfg_, body, outErr);
     }
+    calls[kRouteLocal] = [this, layout = layout_.empty() ? singleTurn(prompt_) : layout_](
+            const BackendRouter::TokenCallback& onToken, const std::atomic<bool>& abort, std::string* err) {
+        const auto body = localPayload(layout, static_cast<bool>(onToken)).dump();
+        return localHttpPostGenerate(cfg_, body, err, onToken, &abort);
+    };
+
+    restoreKvSnapshot(false);
+    const size_t preferred = cfg_.model_type == "local_http" ? kRouteLocal : kRouteRemote;
+    auto text = router_.run(calls, preferred, on_token_, outErr, cancel);
+    if (text && router_.lastRoute().backend == "local_http") {
+        std::lock_guard<std::mutex> lock(kv_mtx_);
+        kv_http_.dirty = true;
+    }
+    return text;
 }
 
+json AiAgent::localPayload(const std::string& prompt, bool stream) const {
+    return localPayload(singleTurn(prompt), stream);
+}
 
+json AiAgent::localPayload(const PromptLayout& layout, bool stream) const {
+    // Формат OpenAI API для локального сервера
+    json payload = {
+        {"model", "local-gguf"},
+        {"messages", layout.messages()},
+        {"max_tokens", cfg_.answer_tokens},
+        {"temperature", 0.7},
+        {"top_p", 0.9},
+        {"stream", stream},
+        // Сервер сравнивает промпт с тем, что уже лежит в KV-кэше слота,
+        // и считает только новые токены
+        {"cache_prompt", true}
+    };
+    if (localSlot() >= 0) payload["id_slot"] = localSlot();
+    return payload;
+}
 
-// ========== НОВЫЕ МЕТОДЫ ДЛЯ РАБОТЫ С КОНТЕКСТОМ ==========
+int AiAgent::localSlot() const {
+    if (cfg_.local_slot_id >= 0) return cfg_.local_slot_id;
+    return cfg_.kv_cache_dir.empty() ? -1 : 0;
+}
 
+std::optional<std::string> AiAgent::libGenerate(const PromptLayout& layout, std::string* err,
+        const SseStream::TokenCallback& onToken, const std::atomic<bool>* abort) const {
+    LlamaBackend::Options opts;
+    opts.model_path = cfg_.local_model_path;
+    opts.n_ctx = cfg_.local_model_n_ctx;
+    opts.n_threads = cfg_.local_threads;
+    opts.max_tokens = cfg_.answer_tokens;
+    if (!llama_.load(opts, err)) return std::nullopt;
+    restoreKvSnapshot(true);
+
+    // Те же сообщения, что уходят llama-server: шаблон модели оформит их сам
+    std::vector<LlamaBackend::Message> messages;
+    for (const auto& m : layout.messages()) {
+        messages.push_back({m.at("role").get<std::string>(), m.at("content").get<std::string>()});
+    }
+    return llama_.chat(messages, onToken, err, abort);
+}
 
 
-bool AiAgent::initDatabase() {
-    if (sqlite3_open(db_path_.c_str(), &db_) != SQLITE_OK) {
-        std::cerr << "Cannot open database: " << sqlite3_errmsg(db_) << \
-            std::endl;
-        return false;
+
+// ========== АСИНХРОННЫЕ ЗАПРОСЫ ==========
+
+PendingAsk AiAgent::askAsync(const std::string& prompt, std::chrono::milliseconds deadline) {
+    PendingAsk pending;
+    auto promise = std::make_shared<std::promise<AskResult>>();
+    pending.result = promise->get_future();
+
+    if (prompt.empty()) {
+        promise->set_value({std::nullopt, "Prompt is empty"});
+        return pending;
+    }
+
+    if (cfg_.model_type == "local_lib") {
+        // Генерацию в процессе не прервать ни по deadline, ни по cancelAsk,
+        // а фоновый поток делил бы модель с синхронным ask()
+        promise->set_value({std::nullopt, "askAsync is not supported for local_lib, use ask()"});
+        return pending;
+    }
+
+    if (!async_) async_ = std::make_unique<AsyncHttp>();
+
+    AsyncHttp::Request req;
+    req.deadline = deadline;
+    req.headers.push_back("Content-Type: application/json");
+
+    const bool local = cfg_.model_type == "local_http";
+    if (local) {
+        req.url = "http://" + cfg_.local_http_host + ":" + cfg_.local_http_port + "/v1/chat/completions";
+        req.body = localPayload(prompt, false).dump();
+    } else {
+        req.url = "https://" + cfg_.host + ":" + cfg_.port + "/api/generate";
+        if (!cfg_.api_key.empty()) req.headers.push_back("x-api-key: " + cfg_.api_key);
+        req.body = json{ {"prompt", prompt} }.dump();
     }
-    return createTables();
+
+    //Разбор ответа выполняется в потоке цикла, состояние агента не трогаем
+    pending.id = async_->submit(std::move(req), [promise, local](HttpResult&& r) {
+        AskResult result;
+        if (!r.ok) {
+            result.error = r.error;
+        } else if (local) {
+            result.text = parseLocalResponse(r.body, &result.error);
+        } else {
+            std::string text = extractTextFromJsonBody(r.body);
+            if (text.empty()) result.error = "Cannot extract \"text\" from JSON response";
+            else result.text = std::move(text);
+        }
+        promise->set_value(std::move(result));
+    });
+    return pending;
 }
 
-bool AiAgent::createTables() {
-    const char* sql = "CREATE TABLE IF NOT EXISTS chat_history ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "session_id TEXT NOT NULL,"
-        "role TEXT NOT NULL,"
-        "content TEXT NOT NULL,"
-        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP"
-        ");"
-        "CREATE INDEX IF NOT EXISTS idx_session ON chat_history(session_id);"
-        "CREATE INDEX IF NOT EXISTS idx_timestamp ON chat_history(timestamp);";
-    
-    char* errMsg = nullptr;
-    if (sqlite3_exec(db_, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "SQL error: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-        return false;
+std::string AiAgent::routeInfo() const {
+    auto onOff = [](bool v) { return v ? "вкл" : "выкл"; };
+    std::ostringstream out;
+    out << "Маршрутизация (переключение: " << onOff(cfg_.route_failover)
+        << ", хедж: " << onOff(cfg_.route_hedge)
+        << ", самый быстрый первым: " << onOff(cfg_.route_prefer_fastest) << ")";
+    for (const auto& s : router_.stats()) {
+        out << "\n    " << s.name << ": запросов " << s.requests << ", ошибок " << s.failures;
+        if (s.requests) out << " (EWMA " << (int)(s.error_rate * 100 + 0.5) << "%)";
+        if (s.requests > s.failures) {
+            out << ", задержка EWMA " << (long)s.ewma_ms << " мс, p95 " << (long)s.p95_ms << " мс";
+        }
+        if (s.hedge_wins) out << ", хедж выиграл " << s.hedge_wins;
+        if (s.cooldown_left.count() > 0) out << ", вне ротации ещё " << s.cooldown_left.count() << " с";
     }
-    return true;
+    const auto route = router_.lastRoute();
+    if (route.backend.empty()) return out.str();
+    out << "\n    Последний ответ: " << route.backend;
+    if (route.failover) out << " (переключение после ошибки)";
+    else if (route.hedge_won) out << " (хедж)";
+    else if (route.hedged) out << " (хедж не понадобился)";
+    return out.str();
+}
+
+// Ctrl-C во время askInterruptible: обработчик только ставит флаг,
+// отмену делает ждущий поток
+static volatile std::sig_atomic_t g_interrupted = 0;
+
+static void onInterrupt(int) {
+    g_interrupted = 1;
 }
 
-void AiAgent::closeDatabase() {
-    if (db_) {
-        sqlite3_close(db_);
-        db_ = nullptr;
+std::optional<std::string> AiAgent::askInterruptible(std::string* err) {
+    g_interrupted = 0;
+    const auto prev = std::signal(SIGINT, onInterrupt);
+
+    // Тот же ask(), что и без --timeout (маршрутизатор, снимки KV-кэша,
+    // вывод по токенам); этот поток только следит за временем и Ctrl-C
+    std::atomic<bool> cancel{false};
+    std::string ask_err;
+    auto pending = std::async(std::launch::async, [this, &cancel, &ask_err] {
+        return ask(&ask_err, &cancel);
+    });
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cli_timeout_);
+    std::string reason;
+    while (pending.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        if (!reason.empty()) continue;
+        if (g_interrupted) reason = "cancelled";
+        else if (std::chrono::steady_clock::now() >= deadline) reason = "deadline exceeded";
+        if (!reason.empty()) cancel = true;
     }
+    std::signal(SIGINT, prev);
+
+    auto text = pending.get();
+    if (!text && err) *err = reason.empty() ? ask_err : reason;
+    return text;
+}
+
+void AiAgent::cancelAsk(AsyncHttp::RequestId id) {
+    if (async_) async_->cancel(id);
 }
 
+
+
+// ========== НОВЫЕ МЕТОДЫ ДЛЯ РАБОТЫ С КОНТЕКСТОМ ==========
+
+
+
 bool AiAgent::enableContext(const std::string& session_id) {
 #ifdef NO_SQLITE
     std::cout << "Context features disabled: SQLite3 not available" << std::endl;
     return false;
 #else
+    saveKvSnapshot();
     current_session_ = session_id.empty() ? "default" : session_id;
     
-    // Закрываем предыдущее соединение если было
-    closeDatabase();
-    
-    if (!initDatabase()) {
+    // Закрываем предыдущее соединение если было (недописанное сохраняется)
+    std::string err;
+    if (!context_.open(db_path_, current_session_, &err)) {
+        std::cerr << err << std::endl;
         std::cerr << "Failed to initialize database for context" << std::endl;
         return false;
     }
     
     context_enabled_ = true;
+    {
+        std::lock_guard<std::mutex> lock(kv_mtx_);
+        kv_http_ = kv_lib_ = KvSnapshot{true, false};
+    }
     std::cout << "✓ Context enabled for session: " << current_session_ << std::endl;
     
     // Проверяем, есть ли предыдущая история
@@ -290,105 +398,120 @@ bool AiAgent::enableContext(const std::string& session_id) {
 }
 
 bool AiAgent::disableContext() {
+    saveKvSnapshot();
     context_enabled_ = false;
-    closeDatabase();
+    context_.close();
     std::cout << "Context disabled" << std::endl;
     return true;
 }
 
+// ========== СНИМКИ KV-КЭША СЕССИЙ ==========
+
+std::string AiAgent::kvSnapshotName() const {
+    // Имя сессии задаёт пользователь: в имени файла оставляем безопасные символы
+    std::string name = "session-";
+    for (unsigned char c : current_session_) {
+        name += (std::isalnum(c) || c == '-' || c == '_') ? (char)c : '_';
+    }
+    return name + ".bin";
+}
+
+bool AiAgent::slotAction(const std::string& action, std::string* err) const {
+    const std::string url = "http://" + cfg_.local_http_host + ":" + cfg_.local_http_port +
+        "/slots/" + std::to_string(localSlot()) + "?action=" + action;
+    auto response = http_.post(url, json{ {"filename", kvSnapshotName()} }.dump(), 60L, err);
+    if (!response) return false;
+    try {
+        auto j = json::parse(*response);
+        if (j.contains("error")) {
+            if (err) *err = j["error"].value("message", j["error"].dump());
+            return false;
+        }
+    } catch (const std::exception& e) {
+        if (err) *err = std::string("Slot response parse error: ") + e.what();
+        return false;
+    }
+    return true;
+}
+
+void AiAgent::restoreKvSnapshot(bool lib) const {
+    std::lock_guard<std::mutex> lock(kv_mtx_);
+    KvSnapshot& snap = lib ? kv_lib_ : kv_http_;
+    if (!kvSnapshotsEnabled() || !snap.restore_pending) return;
+    snap.restore_pending = false;
+
+    // Снимка нет — сессия новая, кэш наполнится по ходу разговора
+    const auto path = std::filesystem::path(cfg_.kv_cache_dir) / kvSnapshotName();
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) return;
+
+    std::string err;
+    const bool ok = lib ? llama_.loadState(path.string(), &err) : slotAction("restore", &err);
+    if (!ok) std::cerr << "KV cache restore failed: " << err << std::endl;
+}
+
+void AiAgent::saveKvSnapshot() {
+    if (!kvSnapshotsEnabled()) return;
+    std::lock_guard<std::mutex> lock(kv_mtx_);
+    std::string err;
+    if (kv_lib_.dirty && llama_.loaded()) {
+        std::error_code ec;
+        std::filesystem::create_directories(cfg_.kv_cache_dir, ec);
+        const auto path = std::filesystem::path(cfg_.kv_cache_dir) / kvSnapshotName();
+        if (!llama_.saveState(path.string(), &err)) {
+            std::cerr << "KV cache save failed: " << err << std::endl;
+        }
+    }
+    // llama-server пишет файл сам, в свой --slot-save-path
+    if (kv_http_.dirty && !slotAction("save", &err)) {
+        std::cerr << "KV cache save failed: " << err << std::endl;
+    }
+    kv_http_.dirty = kv_lib_.dirty = false;
+}
+
 bool AiAgent::saveToContext(const std::string& role, const std::string& content) {
 #ifdef NO_SQLITE
     return false;
 #else
-    if (!context_enabled_ || !db_) {
+    if (!context_enabled_ || !context_.isOpen()) {
         std::cerr << "Context not enabled or database not initialized" << std::endl;
         return false;
     }
 
-    const char* sql = "INSERT INTO chat_history (session_id, role, content) VALUES (?, ?, ?)";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_) << std::endl;
+    // Сообщение сразу попадает в буфер, на диск его допишет фоновый поток
+    context_.append(role, content);
+    return true;
+#endif
+}
+
+bool AiAgent::saveExchangeToContext(const std::string& user, const std::string& assistant) {
+#ifdef NO_SQLITE
+    return false;
+#else
+    if (!context_enabled_ || !context_.isOpen()) {
+        std::cerr << "Context not enabled or database not initialized" << std::endl;
         return false;
     }
-    
-    sqlite3_bind_text(stmt, 1, current_session_.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, role.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, content.c_str(), -1, SQLITE_STATIC);
-    
-    int result = sqlite3_step(stmt);
-    bool success = (result == SQLITE_DONE);
-    
-    if (!success) {
-        std::cerr << "Failed to save to context: " << sqlite3_errmsg(db_) << std::endl;
-    }
-    
-    sqlite3_finalize(stmt);
-    return success;
+
+    context_.appendExchange(user, assistant);
+    return true;
 #endif
 }
 
 std::vector<ChatMessage> AiAgent::getContextHistory(int limit) const {
-    std::vector<ChatMessage> history;
 #ifdef NO_SQLITE
-    return history;
+    return {};
 #else
-    if (!context_enabled_ || !db_) return history;
-
-    const char* sql = "SELECT role, content, timestamp FROM chat_history WHERE session_id = ? ORDER BY timestamp DESC LIMIT ?";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db_) << std::endl;
-        return history;
-    }
-    
-    sqlite3_bind_text(stmt, 1, current_session_.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, limit);
-    
-    int step_result;
-    while ((step_result = sqlite3_step(stmt)) == SQLITE_ROW) {
-        ChatMessage msg;
-        const char* role_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        const char* content_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        const char* timestamp_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        
-        if (role_ptr) msg.role = role_ptr;
-        if (content_ptr) msg.content = content_ptr;
-        if (timestamp_ptr) msg.timestamp = timestamp_ptr;
-        
-        history.push_back(msg);
-    }
-    
-    if (step_result != SQLITE_DONE) {
-        std::cerr << "Error reading context: " << sqlite3_errmsg(db_) << std::endl;
-    }
-    
-    sqlite3_finalize(stmt);
-    
-    // Переворачиваем чтобы получить в хронологическом порядке
-    std::reverse(history.begin(), history.end());
-    return history;
+    if (!context_enabled_ || !context_.isOpen() || limit <= 0) return {};
+    // Последние сообщения отдаются из памяти, без запроса к базе
+    return context_.recent((size_t)limit);
 #endif
 }
 
 bool AiAgent::clearContext() {
-    if (!context_enabled_ || !db_) return false;
+    if (!context_enabled_ || !context_.isOpen()) return false;
 
-    const char* sql = "DELETE FROM chat_history WHERE session_id = ?";
-    sqlite3_stmt* stmt;
-
-    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << \
-            sqlite3_errmsg(db_) << std::endl;
-        return false;
-    }
-
-    sqlite3_bind_text(stmt, 1, current_session_.c_str(), -1, SQLITE_STATIC);
-
-    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
+    bool success = context_.clear();
 
     if (success) {
         std::cout << "Context cleared for session: " << current_session_ << \
@@ -439,7 +562,9 @@ void AiAgent::printCLIUsage() const {
     std::cout << "Выбор модели:\n";
     std::cout << "  --local    - использовать локальную модель\n";
     std::cout << "  --remote  - использовать удаленный API\n";
-    std::cout << "  --model-info              - показать текущие настройки модели\n\n";
+    std::cout << "  --lib      - локальная модель в процессе (llama.cpp, local_model_path)\n";
+    std::cout << "  --model-info              - показать текущие настройки модели\n";
+    std::cout << "  --timeout <сек>           - ограничить время запроса (Ctrl-C отменяет запрос)\n\n";
     
     std::cout << "Режимы:\n";
     std::cout << "  help    - справка по командам\n";
@@ -462,36 +587,46 @@ void AiAgent::printCLIUsage() const {
     std::cout << "  ./ai_agent --cli --enable-context test --local\n";
 }
 
-std::string AiAgent::buildPromptForCommand(const std::string& command, CLIMode mode) const {
-    //ТОЛЬКО пользовательский запрос, системный промпт в методе ask
-    std::string final_command = command;
-    
-    std::string context_str;
-    if (context_enabled_) {
-        auto history = getContextHistory(3);
-        if (!history.empty()) {
-            context_str = "\n\nКонтекст предыдущего разговора:\n";
-            for (const auto& msg : history) {
-                context_str += (msg.role == "user" ? "Пользователь: " : "Ассистент: ") + msg.content + "\n";
-            }
-            context_str += "\nУчитывай этот контекст в ответе.";
-        }
-    }
-    
+PromptLayout AiAgent::buildPromptForCommand(const std::string& command, CLIMode mode) const {
+    // Стабильное — в начало: системный промпт и режим не меняются между
+    // ходами, история растёт только в конец, новый запрос идёт последним.
+    // Так соседние запросы к llama-server делят префикс и он не пересчитывается
+    PromptLayout layout;
+    layout.add(PromptLayout::Tier::System, kSystemPrompt);
+
     std::string mode_str;
-    if (mode != CLIMode::DEFAULT) {
-        switch (mode) {
-            case CLIMode::HELP: mode_str = " (режим помощи)"; break;
-            case CLIMode::TODO: mode_str = " (режим задач)"; break;
-            case CLIMode::TIMER: mode_str = " (режим таймера)"; break;
-            case CLIMode::SUMMARY: mode_str = " (режим суммаризации)"; break;
-            case CLIMode::IDEAS: mode_str = " (режим идей)"; break;
-            case CLIMode::PLANNER: mode_str = " (режим планирования)"; break;
-            default: break;
+    switch (mode) {
+        case CLIMode::HELP: mode_str = "помощи"; break;
+        case CLIMode::TODO: mode_str = "задач"; break;
+        case CLIMode::TIMER: mode_str = "таймера"; break;
+        case CLIMode::SUMMARY: mode_str = "суммаризации"; break;
+        case CLIMode::IDEAS: mode_str = "идей"; break;
+        case CLIMode::PLANNER: mode_str = "планирования"; break;
+        default: break;
+    }
+    const std::string instructions = mode_str.empty() ? "" : "Работай в режиме " + mode_str + ".";
+    if (!instructions.empty()) layout.add(PromptLayout::Tier::Instructions, instructions);
+
+    if (context_enabled_) {
+        // Историю ограничивает не число сообщений, а окно контекста модели:
+        // из последних сообщений берём столько, сколько влезает после
+        // системного промпта, запроса и места под ответ
+        auto history = getContextHistory(kContextCandidates);
+        const size_t fixed = approxTokens(kSystemPrompt) + approxTokens(instructions)
+            + approxTokens(command) + 2 * kMessageOverheadTokens;
+        const size_t budget = historyBudget((size_t)std::max(cfg_.local_model_n_ctx, 0),
+            (size_t)std::max(cfg_.answer_tokens, 0), fixed);
+        const size_t kept = fitNewest(history.size(), budget, [&](size_t i) {
+            return approxTokens(history[i].content) + kMessageOverheadTokens;
+        });
+
+        for (size_t i = history.size() - kept; i < history.size(); ++i) {
+            layout.addHistory(history[i].role, history[i].content);
         }
     }
-    
-    return final_command + mode_str + context_str;
+
+    layout.add(PromptLayout::Tier::Input, command);
+    return layout;
 }
 
 std::string AiAgent::readInputFile(const std::string& filepath) const {
@@ -530,13 +665,14 @@ command, std::string* outErr) {
  
     std::string saved_prompt = prompt_;
 
-    prompt_ = buildPromptForCommand(final_command, cli_mode_);
+    layout_ = buildPromptForCommand(final_command, cli_mode_);
+    prompt_ = layout_.flatten();
 
-    auto result = ask(outErr);
+    auto result = cli_timeout_ > 0 ? askInterruptible(outErr) : ask(outErr);
+    layout_.clear();
 
     if (context_enabled_ && result) {
-        saveToContext("user", final_command);
-        saveToContext("assistant", *result);
+        saveExchangeToContext(final_command, *result);
     }
 
     prompt_ = saved_prompt;
@@ -567,6 +703,13 @@ std::optional<std::string> AiAgent::processCLICommand(int argc, char* argv[], st
                 std::cout << "Модель: " << cfg_.local_model_path << std::endl;
             }
         }
+        else if (arg == "--lib") {
+            cfg_.model_type = "local_lib";
+            std::cout << "Режим изменен на: ЛОКАЛЬНАЯ МОДЕЛЬ (llama.cpp)" << \
+                std::endl;
+            std::cout << "Модель: " << (cfg_.local_model_path.empty() ? \
+                "не указана" : cfg_.local_model_path) << std::endl;
+        }
         else if (arg == "--remote") {
             cfg_.model_type = "remote";
             std::cout << "Режим изменен на: УДАЛЕННЫЙ API" << std::endl;
@@ -581,11 +724,35 @@ std::optional<std::string> AiAgent::processCLICommand(int argc, char* argv[], st
                     cfg_.local_http_port + "\n";
                 info += "  Модель: " + (cfg_.local_model_path.empty() ? \
                     "не указана" : cfg_.local_model_path);
+                if (localSlot() >= 0) {
+                    info += "\n  Слот: " + std::to_string(localSlot());
+                }
+                if (!cfg_.kv_cache_dir.empty()) {
+                    info += "\n  Снимки KV-кэша: " + cfg_.kv_cache_dir;
+                }
+            }
+            else if (cfg_.model_type == "local_lib") {
+                info += "ЛОКАЛЬНАЯ МОДЕЛЬ (llama.cpp)\n";
+                info += "  Модель: " + (cfg_.local_model_path.empty() ? \
+                    "не указана" : cfg_.local_model_path) + "\n";
+                info += "  Контекст: " + std::to_string(cfg_.local_model_n_ctx) + \
+                    ", потоков: " + (cfg_.local_threads > 0 ? \
+                    std::to_string(cfg_.local_threads) : std::string("авто"));
+                if (!cfg_.kv_cache_dir.empty()) {
+                    info += "\n  Снимки KV-кэша: " + cfg_.kv_cache_dir;
+                }
+                if (!LlamaBackend::available()) {
+                    info += "\n  Агент собран без llama.cpp (-DAI_AGENT_LLAMA_LIB=ON)";
+                }
             }
             else {
                 info += "УДАЛЕННЫЙ API\n";
                 info += "  Сервер: " + cfg_.host + ":" + cfg_.port;
             }
+            const auto tls = TlsContext::instance().stats();
+            if (cfg_.model_type != "local_lib") info += "\n  " + routeInfo();
+            info += "\n  TLS-рукопожатия: полных " + std::to_string(tls.full) + \
+                ", возобновлённых " + std::to_string(tls.resumed);
             return info;
         }
     }
@@ -606,6 +773,17 @@ std::optional<std::string> AiAgent::processCLICommand(int argc, char* argv[], st
         if (arg == "--mode" && i + 1 < argc) {
             setCLIMode(stringToMode(argv[i + 1]));
             i++; //пропускаем следующий аргумент
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            const char* value = argv[i + 1];
+            const char* end = value + std::strlen(value);
+            int seconds = 0;
+            auto [ptr, ec] = std::from_chars(value, end, seconds);
+            if (ec != std::errc() || ptr != end || seconds <= 0) {
+                if (outErr) *outErr = std::string("Invalid --timeout: ") + value;
+                return std::nullopt;
+            }
+            cli_timeout_ = seconds;
+            i++; //пропускаем следующий аргумент
         } else if (arg == "--file" && i + 1 < argc) {
             file_for_summary = argv[i + 1];
             i++; //пропускаем следующий аргумент
@@ -661,13 +839,16 @@ std::optional<std::string> AiAgent::processCLICommand(int argc, char* argv[], st
 void AiAgent::runInteractiveMode() {
     std::cout << "AI Agent CLI - Интерактивный режим\n";
     std::cout << "Команды: 'quit' - выход, 'help' - справка, 'mode <режим>' - смена режима\n";
-    std::cout << "Модель: 'local' - локальная, 'remote' - удаленная, 'model-info' - информация\n";
+    std::cout << "Модель: 'local' - локальная, 'lib' - llama.cpp в процессе, 'remote' - удаленная, 'model-info' - информация\n";
     
     std::cout << "Текущая модель: ";
     if (cfg_.model_type == "local_http") {
         std::cout << "ЛОКАЛЬНАЯ (" << cfg_.local_http_host << ":" << \
             cfg_.local_http_port << ")";
     }
+    else if (cfg_.model_type == "local_lib") {
+        std::cout << "ЛОКАЛЬНАЯ (llama.cpp)";
+    }
     else {
         std::cout << "УДАЛЕННАЯ (" << cfg_.host << ":" << cfg_.port << ")";
     }
@@ -685,12 +866,22 @@ void AiAgent::runInteractiveMode() {
     }
     std::cout << std::endl;
     
+    //Локальная модель печатает токены по мере генерации
+    bool streamed = false;
+    setTokenCallback([&streamed](const std::string& token) {
+        streamed = true;
+        std::cout << token << std::flush;
+    });
+
     std::string input;
     while (true) {
         std::cout << "[" << modeToString(cli_mode_) << "] > ";
         if (cfg_.model_type == "local_http") {
             std::cout << "[LOCAL]";
         }
+        else if (cfg_.model_type == "local_lib") {
+            std::cout << "[LIB]";
+        }
         else {
             std::cout << "[REMOTE]";
         }
@@ -712,6 +903,13 @@ void AiAgent::runInteractiveMode() {
                 cfg_.local_http_port << std::endl;
             continue;
         }
+        if (input == "lib") {
+            cfg_.model_type = "local_lib";
+            std::cout << "Переключено на ЛОКАЛЬНУЮ МОДЕЛЬ (llama.cpp)" << std::endl;
+            std::cout << "Модель: " << (cfg_.local_model_path.empty() ? \
+                "не указана" : cfg_.local_model_path) << std::endl;
+            continue;
+        }
         if (input == "remote") {
             cfg_.model_type = "remote";
             std::cout << "Переключено на УДАЛЕННЫЙ API" << std::endl;
@@ -728,11 +926,24 @@ void AiAgent::runInteractiveMode() {
                 std::cout << "Модель: " << (cfg_.local_model_path.empty() ? \
                     "не указана" : cfg_.local_model_path) << std::endl;
             }
+            else if (cfg_.model_type == "local_lib") {
+                std::cout << "ЛОКАЛЬНАЯ (llama.cpp)" << std::endl;
+                std::cout << "Модель: " << (cfg_.local_model_path.empty() ? \
+                    "не указана" : cfg_.local_model_path) << std::endl;
+                if (llama_.loaded()) {
+                    std::cout << "Токенов из KV-кэша в последнем ответе: " << \
+                        llama_.lastReusedTokens() << std::endl;
+                }
+            }
             else {
                 std::cout << "УДАЛЕННЫЙ API" << std::endl;
                 std::cout << "Сервер: " << cfg_.host << ":" << cfg_.port << \
                     std::endl;
             }
+            if (cfg_.model_type != "local_lib") std::cout << routeInfo() << std::endl;
+            const auto tls = TlsContext::instance().stats();
+            std::cout << "TLS-рукопожатия: полных " << tls.full << \
+                ", возобновлённых " << tls.resumed << std::endl;
             continue;
         }
 
@@ -777,14 +988,21 @@ void AiAgent::runInteractiveMode() {
             continue;
         }
         
+        streamed = false;
         auto result = executeCLICommand(input, nullptr);
         if (result) {
-            std::cout << *result << "\n";
+            if (streamed) {
+                std::cout << "\n";
+            } else {
+                std::cout << *result << "\n";
+            }
         } else {
+            if (streamed) std::cout << "\n";
             std::cout << "✗ Ошибка выполнения команды\n";
         }
     }
     
+    setTokenCallback(nullptr);
     std::cout << "Интерактивный режим завершен.\n";
 }
 
@@ -795,52 +1013,35 @@ void AiAgent::runInteractiveMode() {
 
 //curl for local model
 
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, \
-    std::string* response) {
-    size_t total_size = size * nmemb;
-    response->append((char*)contents, total_size);
-    return total_size;
-}
+std::optional<std::string> AiAgent::localHttpPostGenerate(const AiConfig& cfg, const std::string& jsonBody, std::string* err,
+    const SseStream::TokenCallback& onToken, const std::atomic<bool>* abort) const {
+    std::string url = "http://" + cfg.local_http_host + ":" + cfg.local_http_port + "/v1/chat/completions";
 
-std::optional<std::string> AiAgent::localHttpPostGenerate(const AiConfig& cfg, const std::string& jsonBody, std::string* err) {
-    CURL* curl;
-    CURLcode res;
-    std::string response;
-    
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    
-    if(!curl) {
-        if (err) *err = "curl_easy_init failed";
+    if (!onToken) {
+        auto response = http_.post(url, jsonBody, 60L, err, abort);
+        if (!response) return std::nullopt;
+        return parseLocalResponse(*response, err);
+    }
+
+    //Поток SSE разбираем по мере прихода, не дожидаясь конца генерации
+    SseStream stream(onToken);
+    if (!http_.post(url, jsonBody, SseStream::curlWrite, &stream, 60L, err, abort)) {
         return std::nullopt;
     }
-    
-    std::string url = "http://" + cfg.local_http_host + ":" + cfg.local_http_port + "/v1/chat/completions";
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonBody.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, jsonBody.size());
-    
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
-    
-    res = curl_easy_perform(curl);
-    
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    
-    if(res != CURLE_OK) {
-        if (err) *err = std::string("curl_easy_perform() failed: ") + curl_easy_strerror(res);
+    stream.finish();
+
+    if (!stream.error().empty()) {
+        if (err) *err = "Server error: " + stream.error();
         return std::nullopt;
     }
-    
+    if (stream.text().empty()) {
+        if (err) *err = "Unexpected response format: " + stream.raw();
+        return std::nullopt;
+    }
+    return stream.text();
+}
+
+std::optional<std::string> AiAgent::parseLocalResponse(const std::string& response, std::string* err) {
     try {
         auto j = json::parse(response);
         
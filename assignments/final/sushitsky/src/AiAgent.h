@@ -1,9 +1,21 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <nlohmann/json.hpp>
-#include <sqlite3.h>
 #include <vector>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <mutex>
+#include "HttpsPool.h"
+#include "SseStream.h"
+#include "AsyncHttp.h"
+#include "CurlClient.h"
+#include "ContextStore.h"
+#include "PromptLayout.h"
+#include "LlamaBackend.h"
+#include "BackendRouter.h"
 
 struct AiConfig {
     std::string model_type = "remote"; // "remote", "local_http", "local_lib"
@@ -15,13 +27,38 @@ struct AiConfig {
     std::string local_http_port = "8080";
     std::string local_model_path;
     int local_model_n_ctx = 4096;
+    // Сколько токенов оставить под ответ модели (max_tokens)
+    int answer_tokens = 500;
+    // Слот llama-server (id_slot): запросы одной сессии попадают в один слот
+    // и переиспользуют его KV-кэш. -1 — слот выбирает сервер
+    int local_slot_id = -1;
+    // Потоки llama.cpp для local_lib: 0 — по числу ядер
+    int local_threads = 0;
+    // Каталог снимков KV-кэша сессий (пусто — снимки выключены). Для
+    // local_http он же должен быть --slot-save-path у llama-server
+    std::string kv_cache_dir;
+
+    // Маршрутизация remote/local_http: model_type задаёт предпочтение,
+    // при ошибке запрос уходит во второй бэкенд. Страховка медленного
+    // ответа вторым бэкендом (hedge) — только по явному включению
+    bool route_failover = true;
+    bool route_hedge = false;
+    // Уводить запросы с выбранного бэкенда, если второй вдвое быстрее
+    bool route_prefer_fastest = false;
+    // Через сколько мс страховать запрос, пока нет замеров для p95
+    int route_hedge_ms = 3000;
 };
 
-//Структура для хранения истории сообщений
-struct ChatMessage {
-    std::string role;    //"user" или "assistant"
-    std::string content;
-    std::string timestamp;
+//Результат асинхронного запроса: text пуст при ошибке (описание в error)
+struct AskResult {
+    std::optional<std::string> text;
+    std::string error;
+};
+
+//Запрос в работе: id для отмены и future с результатом
+struct PendingAsk {
+    AsyncHttp::RequestId id = 0;
+    std::future<AskResult> result;
 };
 
 class AiAgent {
@@ -48,10 +85,25 @@ public:
 
     // Выполнить запрос и вернуть распарсенный "text" из ответа
     // Возвращает std::nullopt при ошибке (описание в outErr, если передан)
-    std::optional<std::string> ask(std::string* outErr = nullptr) const;
+    // cancel, если задан, прерывает запрос: ask() вернёт ошибку "cancelled"
+    std::optional<std::string> ask(std::string* outErr = nullptr,
+        const std::atomic<bool>* cancel = nullptr) const;
 
     // Явно задать промпт программно (не из файла)
-    void setPrompt(std::string p) { prompt_ = std::move(p); }
+    void setPrompt(std::string p) { prompt_ = std::move(p); layout_.clear(); }
+
+    // Потоковый режим для локальной модели: колбэк вызывается на каждый токен
+    // по мере генерации. Пустой колбэк — обычный режим (ждём весь ответ)
+    void setTokenCallback(SseStream::TokenCallback cb) { on_token_ = std::move(cb); }
+
+    // Асинхронный запрос с готовым промптом: не блокирует поток, все запросы
+    // агента обслуживаются одним событийным циклом (curl_multi).
+    // deadline — предельное время запроса, после него future вернёт ошибку
+    PendingAsk askAsync(const std::string& prompt,
+        std::chrono::milliseconds deadline = std::chrono::seconds(60));
+
+    // Отменить запрос, начатый askAsync (его future вернёт ошибку "cancelled")
+    void cancelAsk(AsyncHttp::RequestId id);
 
     //Новые методы для CLI
     std::optional<std::string> processCLICommand(int argc, char* argv[], \
@@ -71,46 +123,114 @@ public:
     bool enableContext(const std::string& session_id = "default");
     bool disableContext();
     bool saveToContext(const std::string& role, const std::string& content);
+    // Пара вопрос/ответ пишется одной транзакцией
+    bool saveExchangeToContext(const std::string& user, const std::string& assistant);
     std::vector<ChatMessage> getContextHistory(int limit = 10) const;
     bool clearContext();
     std::string getCurrentSession() const { return current_session_; }
 
 private:
     // ---- низкоуровневые помощники ----
-    static std::optional<std::string> httpsPostGenerate(
-        const AiConfig& cfg, const std::string& jsonBody, std::string* err);
+    // abort — флаг маршрутизатора: ответ уже не нужен, запрос прерывается
+    std::optional<std::string> httpsPostGenerate(
+        const AiConfig& cfg, const std::string& jsonBody, std::string* err,
+        const std::atomic<bool>* abort = nullptr) const;
 
     // Простой разбор JSON: ожидаем { "text": "<строка>" }
-    static std::string extractTextFromJsonBody(const std::string& body);
+    static std::string extractTextFromJsonBody(std::string_view body);
+
+    // Тело запроса к локальному серверу (формат OpenAI API)
+    nlohmann::json localPayload(const std::string& prompt, bool stream) const;
+    nlohmann::json localPayload(const PromptLayout& layout, bool stream) const;
+
+    // Разбор ответа локального сервера: choices[0].message.content
+    static std::optional<std::string> parseLocalResponse(const std::string& response, std::string* err);
 
     static bool readWholeFile(const std::string& path, std::string& out, std::string* err);
 
     //CLI
-    std::string buildPromptForCommand(const std::string& command, \
+    PromptLayout buildPromptForCommand(const std::string& command, \
         CLIMode mode) const;
     std::string readInputFile(const std::string& filepath) const;
     std::optional<std::string> executeCLICommand(const std::string& command, \
         std::string* outErr);
 
-    //Методы для работы с SQLite
-    bool initDatabase();
-    bool createTables();
-    void closeDatabase();
+    // ask() в отдельном потоке: не дольше cli_timeout_ секунд,
+    // Ctrl-C отменяет запрос, а не убивает процесс
+    std::optional<std::string> askInterruptible(std::string* err);
 
     //Local model
-    static std::optional<std::string> localHttpPostGenerate(const AiConfig& cfg, const std::string& jsonBody, std::string* err);
+    std::optional<std::string> localHttpPostGenerate(const AiConfig& cfg, const std::string& jsonBody, std::string* err,
+        const SseStream::TokenCallback& onToken = nullptr, const std::atomic<bool>* abort = nullptr) const;
+    // local_lib: генерация в процессе, модель загружается при первом вызове.
+    // Прервать её можно только флагом abort, поэтому askAsync local_lib не принимает
+    std::optional<std::string> libGenerate(const PromptLayout& layout, std::string* err,
+        const SseStream::TokenCallback& onToken = nullptr, const std::atomic<bool>* abort = nullptr) const;
+
+    // Снимки KV-кэша сессии: поднимаются перед первым локальным запросом
+    // сессии, сохраняются при уходе из неё (смена сессии, выключение
+    // контекста, выход)
+    struct KvSnapshot {
+        bool restore_pending = false;
+        bool dirty = false;     // в этой сессии были локальные ответы
+    };
+    bool kvSnapshotsEnabled() const { return context_enabled_ && !cfg_.kv_cache_dir.empty(); }
+    std::string kvSnapshotName() const;
+    void restoreKvSnapshot(bool lib) const;
+    void saveKvSnapshot();
+    // Слот llama-server: со снимками он нужен фиксированный
+    int localSlot() const;
+    // POST /slots/<id>?action=save|restore
+    bool slotAction(const std::string& action, std::string* err) const;
+
+    // Бэкенды маршрутизатора (индексы в BackendRouter)
+    static constexpr size_t kRouteRemote = 0;
+    static constexpr size_t kRouteLocal = 1;
+    // Статистика маршрутизатора для model-info
+    std::string routeInfo() const;
 
 private:
     AiConfig cfg_;
     std::string prompt_;
+    // Раскладка промпта CLI-команды для локальной модели; пуста, если
+    // промпт задан строкой (loadPrompt/setPrompt)
+    PromptLayout layout_;
 
     //CLI
     CLIMode cli_mode_ = CLIMode::DEFAULT;
     std::string original_prompt_;
-
-    //Контекст и база данных
-    sqlite3* db_ = nullptr;
+    SseStream::TokenCallback on_token_;
+    // --timeout: предельное время запроса команды в секундах; 0 — обычный ask()
+    int cli_timeout_ = 0;
+
+    // Модель и KV-кэш local_lib живут всё время работы агента
+    mutable LlamaBackend llama_;
+    mutable KvSnapshot kv_http_;
+    mutable KvSnapshot kv_lib_;
+    // Флаги снимков и сами восстановление/сохранение: ask() и вызовы из
+    // фоновых потоков не должны поднять снимок дважды или потерять dirty
+    mutable std::mutex kv_mtx_;
+
+    //Контекст и база данных.
+    // Недавняя история живёт в памяти, в SQLite она пишется фоновым потоком
+    // Сколько последних сообщений держать в памяти: из них по бюджету токенов
+    // выбирается история для промпта
+    static constexpr int kContextCandidates = 64;
+    mutable ContextStore context_{kContextCandidates};
     bool context_enabled_ = false;
     std::string current_session_;
     std::string db_path_ = "chat_context.db";
+
+    // keep-alive соединения к удалённому API переживают отдельные вызовы ask()
+    mutable HttpsPool pool_;
+
+    // Один curl-handle к локальному серверу на всё время жизни агента
+    mutable CurlClient http_;
+
+    // Событийный цикл для askAsync, создаётся при первом асинхронном запросе
+    std::unique_ptr<AsyncHttp> async_;
+
+    // Последним: разрушается первым и дожидается проигравших гонку запросов,
+    // пока пул соединений и curl-клиент ещё живы
+    mutable BackendRouter router_{{"remote", "local_http"}};
 };
@@ -0,0 +1,156 @@
+#include "AsyncHttp.h"
+#include "CurlClient.h"
+
+AsyncHttp::AsyncHttp() {
+    CurlClient::globalInit();
+    multi_ = curl_multi_init();
+    loop_ = std::thread(&AsyncHttp::run, this);
+}
+
+AsyncHttp::~AsyncHttp() {
+    stop_ = true;
+    curl_multi_wakeup(multi_);
+    if (loop_.joinable()) loop_.join();
+
+    curl_multi_cleanup(multi_);
+}
+
+size_t AsyncHttp::writeCallback(void* contents, size_t size, size_t nmemb, void* userdata) {
+    const size_t total_size = size * nmemb;
+    static_cast<std::string*>(userdata)->append(static_cast<char*>(contents), total_size);
+    return total_size;
+}
+
+AsyncHttp::RequestId AsyncHttp::submit(Request req, Completion done) {
+    auto* t = new Transfer;
+    t->id = next_id_++;
+    t->req = std::move(req);
+    t->done = std::move(done);
+    const RequestId id = t->id;
+
+    ++in_flight_;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        pending_.push_back(t);
+    }
+    curl_multi_wakeup(multi_);
+    return id;
+}
+
+void AsyncHttp::cancel(RequestId id) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        cancels_.push_back(id);
+    }
+    curl_multi_wakeup(multi_);
+}
+
+// -------- работа внутри потока цикла --------
+void AsyncHttp::startTransfer(Transfer* t) {
+    t->easy = curl_easy_init();
+    if (!t->easy) {
+        HttpResult r;
+        r.error = "curl_easy_init failed";
+        finish(t, std::move(r));
+        return;
+    }
+
+    for (const auto& h : t->req.headers) t->headers = curl_slist_append(t->headers, h.c_str());
+
+    curl_easy_setopt(t->easy, CURLOPT_URL, t->req.url.c_str());
+    curl_easy_setopt(t->easy, CURLOPT_POST, 1L);
+    curl_easy_setopt(t->easy, CURLOPT_POSTFIELDS, t->req.body.c_str());
+    curl_easy_setopt(t->easy, CURLOPT_POSTFIELDSIZE, (long)t->req.body.size());
+    curl_easy_setopt(t->easy, CURLOPT_HTTPHEADER, t->headers);
+    curl_easy_setopt(t->easy, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(t->easy, CURLOPT_WRITEDATA, &t->response);
+    curl_easy_setopt(t->easy, CURLOPT_PRIVATE, t);
+    curl_easy_setopt(t->easy, CURLOPT_NOSIGNAL, 1L);
+    // Дедлайн отсчитывается curl от момента старта передачи
+    curl_easy_setopt(t->easy, CURLOPT_TIMEOUT_MS, (long)t->req.deadline.count());
+
+    active_[t->id] = t;
+    curl_multi_add_handle(multi_, t->easy);
+}
+
+void AsyncHttp::finish(Transfer* t, HttpResult&& result) {
+    if (t->easy) {
+        curl_multi_remove_handle(multi_, t->easy);
+        curl_easy_cleanup(t->easy);
+    }
+    if (t->headers) curl_slist_free_all(t->headers);
+    active_.erase(t->id);
+
+    if (t->done) t->done(std::move(result));
+    delete t;
+    --in_flight_;
+}
+
+void AsyncHttp::run() {
+    while (true) {
+        std::vector<Transfer*> pending;
+        std::vector<RequestId> cancels;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            pending.swap(pending_);
+            cancels.swap(cancels_);
+        }
+
+        for (auto* t : pending) startTransfer(t);
+
+        for (RequestId id : cancels) {
+            auto it = active_.find(id);
+            if (it == active_.end()) continue;
+            HttpResult r;
+            r.error = "cancelled";
+            finish(it->second, std::move(r));
+        }
+
+        if (stop_) break;
+
+        int running = 0;
+        curl_multi_perform(multi_, &running);
+
+        CURLMsg* msg;
+        int left = 0;
+        while ((msg = curl_multi_info_read(multi_, &left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            Transfer* t = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &t);
+            if (!t) continue;
+
+            HttpResult r;
+            const CURLcode code = msg->data.result;
+            if (code == CURLE_OK) {
+                r.ok = true;
+                curl_easy_getinfo(t->easy, CURLINFO_RESPONSE_CODE, &r.status);
+                r.body = std::move(t->response);
+            } else if (code == CURLE_OPERATION_TIMEDOUT) {
+                r.error = "deadline exceeded";
+            } else {
+                r.error = std::string("curl failed: ") + curl_easy_strerror(code);
+            }
+            finish(t, std::move(r));
+        }
+
+        // Спим до событий на сокетах, таймаута curl или curl_multi_wakeup
+        curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+    }
+
+    // Остановка: всё незавершённое закрываем с ошибкой
+    while (!active_.empty()) {
+        HttpResult r;
+        r.error = "agent is shutting down";
+        finish(active_.begin()->second, std::move(r));
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto* t : pending_) {
+        HttpResult r;
+        r.error = "agent is shutting down";
+        if (t->done) t->done(std::move(r));
+        delete t;
+        --in_flight_;
+    }
+    pending_.clear();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "curl/curl.h"
+
+// Итог одного HTTP-запроса
+struct HttpResult {
+    bool ok = false;          // transport отработал (статус может быть любым)
+    long status = 0;
+    std::string body;
+    std::string error;        // описание ошибки, если !ok
+};
+
+// Событийный цикл поверх curl_multi: один фоновый поток обслуживает
+// сколько угодно одновременных запросов, без отдельного потока на каждый.
+// Соединения к одному хосту переиспользуются кэшем curl_multi.
+class AsyncHttp {
+public:
+    using RequestId = uint64_t;
+    using Completion = std::function<void(HttpResult&&)>;
+
+    struct Request {
+        std::string url;
+        std::vector<std::string> headers;   // строки вида "Name: value"
+        std::string body;                   // POST-тело
+        std::chrono::milliseconds deadline{60000};
+    };
+
+    AsyncHttp();
+    ~AsyncHttp();
+
+    AsyncHttp(const AsyncHttp&) = delete;
+    AsyncHttp& operator=(const AsyncHttp&) = delete;
+
+    // Поставить запрос в очередь. done вызывается ровно один раз из потока цикла:
+    // по завершении, по истечении deadline или после cancel()
+    RequestId submit(Request req, Completion done);
+
+    // Отменить запрос; если он уже завершился — ничего не происходит
+    void cancel(RequestId id);
+
+    // Сколько запросов сейчас в работе
+    size_t inFlight() const { return in_flight_.load(); }
+
+private:
+    struct Transfer {
+        RequestId id = 0;
+        Request req;
+        Completion done;
+        CURL* easy = nullptr;
+        curl_slist* headers = nullptr;
+        std::string response;
+    };
+
+    void run();
+    void startTransfer(Transfer* t);
+    void finish(Transfer* t, HttpResult&& result);
+
+    static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userdata);
+
+private:
+    CURLM* multi_ = nullptr;
+    std::thread loop_;
+    std::atomic<bool> stop_{false};
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<RequestId> next_id_{1};
+
+    // Очереди, которые пополняются из любых потоков и разбираются циклом
+    std::mutex mtx_;
+    std::vector<Transfer*> pending_;
+    std::vector<RequestId> cancels_;
+
+    // Активные передачи принадлежат только потоку цикла
+    std::unordered_map<RequestId, Transfer*> active_;
+};
@@ -0,0 +1,307 @@
+#include "BackendRouter.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+
+//Состояние одного запроса, общее для всех его попыток. Попытка может
+//пережить run(), поэтому оно живёт в shared_ptr
+struct BackendRouter::Race {
+    struct Result {
+        bool done = false;
+        std::optional<std::string> text;
+        std::string error;
+    };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    TokenCallback onToken;
+    //Попытка, чей текст уже ушёл в onToken; -1 — никто, -2 — запрос завершён
+    std::atomic<int> owner{-1};
+    //Ответ больше не нужен: незавершённые попытки прерываются
+    std::atomic<bool> abort{false};
+    std::vector<Result> results;   //по номеру попытки
+};
+
+BackendRouter::BackendRouter(std::vector<std::string> names) {
+    for (auto& name : names) {
+        Backend b;
+        b.name = std::move(name);
+        backends_.push_back(std::move(b));
+    }
+}
+
+BackendRouter::~BackendRouter() {
+    for (auto& f : stragglers_) f.wait();
+}
+
+void BackendRouter::setOptions(const Options& opts) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    opts_ = opts;
+}
+
+double BackendRouter::score(const Backend& b) {
+    if (b.window.empty()) {
+        return b.failures ? std::numeric_limits<double>::infinity() : 0.0;
+    }
+    //Ошибка стоит ещё одной попытки: делим на долю успешных
+    return b.ewma_ms / std::max(0.1, 1.0 - b.error_rate);
+}
+
+double BackendRouter::p95(const Backend& b) {
+    if (b.window.empty()) return 0.0;
+    std::vector<double> w(b.window.begin(), b.window.end());
+    const size_t k = std::min(w.size() - 1, w.size() * 95 / 100);
+    std::nth_element(w.begin(), w.begin() + k, w.end());
+    return w[k];
+}
+
+std::vector<size_t> BackendRouter::order(const std::vector<Call>& calls, size_t preferred) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const auto now = Clock::now();
+    std::vector<size_t> up, down;
+    for (size_t i = 0; i < calls.size() && i < backends_.size(); ++i) {
+        if (!calls[i]) continue;
+        (backends_[i].down_until > now ? down : up).push_back(i);
+    }
+    std::stable_sort(up.begin(), up.end(), [&](size_t a, size_t b) {
+        return score(backends_[a]) < score(backends_[b]);
+    });
+    std::stable_sort(down.begin(), down.end(), [&](size_t a, size_t b) {
+        return backends_[a].down_until < backends_[b].down_until;
+    });
+
+    //Выбор пользователя остаётся первым, пока он в ротации (ошибки
+    //выводят его оттуда). С prefer_fastest он уступает ещё и измеренной
+    //альтернативе, которая быстрее его в kStickiness раз; раз в kProbeEvery
+    //запросов он и тогда идёт первым, чтобы его задержка не устаревала
+    auto pref = std::find(up.begin(), up.end(), preferred);
+    if (pref != up.end()) {
+        const Backend& p = backends_[preferred];
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i : up) {
+            if (i != preferred && !backends_[i].window.empty()) best = std::min(best, backends_[i].ewma_ms);
+        }
+        if (!opts_.prefer_fastest || p.window.empty() || p.ewma_ms <= kStickiness * best ||
+            runs_ % kProbeEvery == 0) {
+            std::rotate(up.begin(), pref, pref + 1);
+        }
+    }
+
+    if (!opts_.failover) {
+        //Без переключения — только выбранный бэкенд, даже если он вне ротации
+        return calls.size() > preferred && calls[preferred] ? std::vector<size_t>{preferred}
+                                                            : std::vector<size_t>{};
+    }
+    up.insert(up.end(), down.begin(), down.end());
+    return up;
+}
+
+std::chrono::milliseconds BackendRouter::hedgeDelay(size_t i) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const Backend& b = backends_[i];
+    if (b.window.size() < kMinSamples) return opts_.hedge_default;
+    const auto p = std::chrono::milliseconds((long long)p95(b));
+    return std::max(opts_.hedge_min, p);
+}
+
+void BackendRouter::record(size_t i, bool ok, double ms) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Backend& b = backends_[i];
+    ++b.requests;
+    if (ok) {
+        //Задержку меряем только у успешных ответов: быстрый отказ не должен
+        //выглядеть быстрым бэкендом
+        b.ewma_ms = b.window.empty() ? ms : kAlpha * ms + (1 - kAlpha) * b.ewma_ms;
+        b.window.push_back(ms);
+        if (b.window.size() > kWindow) b.window.pop_front();
+        b.error_rate *= (1 - kAlpha);
+        b.consecutive_failures = 0;
+        b.down_until = {};
+    } else {
+        ++b.failures;
+        b.error_rate = kAlpha + (1 - kAlpha) * b.error_rate;
+        if (++b.consecutive_failures >= opts_.max_consecutive_failures) {
+            b.down_until = Clock::now() + opts_.cooldown;
+        }
+    }
+}
+
+void BackendRouter::launch(const std::shared_ptr<Race>& race, size_t slot, size_t backend, const Call& call) {
+    auto task = std::async(std::launch::async, [this, race, slot, backend, call]() {
+        TokenCallback sink;
+        if (race->onToken) {
+            sink = [race, slot](const std::string& token) {
+                int expected = -1;
+                if (race->owner.compare_exchange_strong(expected, (int)slot) || expected == (int)slot) {
+                    race->onToken(token);
+                }
+            };
+        }
+        std::string error;
+        const auto start = Clock::now();
+        auto text = call(sink, race->abort, &error);
+        //Прерванная попытка ничего не говорит о бэкенде
+        if (text || !race->abort) {
+            record(backend, text.has_value(),
+                   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        {
+            std::lock_guard<std::mutex> lock(race->mtx);
+            race->results[slot] = {true, std::move(text), std::move(error)};
+        }
+        race->cv.notify_all();
+    });
+    std::lock_guard<std::mutex> lock(mtx_);
+    stragglers_.push_back(std::move(task));
+}
+
+std::optional<std::string> BackendRouter::run(const std::vector<Call>& calls, size_t preferred,
+        const TokenCallback& onToken, std::string* err, const std::atomic<bool>* cancel) {
+    //С cancel ожидание просыпается периодически, чтобы проверить флаг
+    const auto poll = std::chrono::milliseconds(100);
+    Options opts;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        opts = opts_;
+        stragglers_.erase(std::remove_if(stragglers_.begin(), stragglers_.end(), [](std::future<void>& f) {
+            return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }), stragglers_.end());
+    }
+
+    const auto attempts = order(calls, preferred);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ++runs_;
+    }
+    if (attempts.empty()) {
+        if (err) *err = "No backend available";
+        return std::nullopt;
+    }
+
+    auto race = std::make_shared<Race>();
+    race->onToken = onToken;
+    race->results.resize(attempts.size());
+
+    size_t launched = 0;
+    bool hedged = false;
+    launch(race, launched++, attempts[0], calls[attempts[0]]);
+    const auto hedge_at = Clock::now() + hedgeDelay(attempts[0]);
+
+    int winner = -1;
+    bool cancelled = false;
+    std::unique_lock<std::mutex> lk(race->mtx);
+    while (true) {
+        if (cancel && cancel->load()) {
+            cancelled = true;
+            break;
+        }
+        const auto& res = race->results;
+        const int owner = race->owner.load();
+        //Чей текст уже выводится, того и ждём, если только он не упал
+        const bool owner_failed = owner >= 0 && res[owner].done && !res[owner].text;
+        for (size_t s = 0; s < launched && winner < 0; ++s) {
+            if (res[s].done && res[s].text && (owner < 0 || owner == (int)s || owner_failed)) winner = (int)s;
+        }
+        if (winner >= 0) {
+            //Закрываем вывод для проигравших; если кто-то успел начать
+            //отвечать по частям, решение пересматриваем
+            int expected = -1;
+            if (owner >= 0 || race->owner.compare_exchange_strong(expected, -2) || expected == winner) break;
+            winner = -1;
+            continue;
+        }
+
+        const bool in_flight = std::any_of(res.begin(), res.begin() + launched,
+                                           [](const Race::Result& r) { return !r.done; });
+        if (!in_flight) {
+            if (launched == attempts.size()) break;
+            //Все запущенные упали — сразу переходим к следующему бэкенду
+            launch(race, launched, attempts[launched], calls[attempts[launched]]);
+            ++launched;
+            continue;
+        }
+        if (opts.hedge && !hedged && launched < attempts.size() && owner < 0) {
+            const auto until = cancel ? std::min(hedge_at, Clock::now() + poll) : hedge_at;
+            if (race->cv.wait_until(lk, until) == std::cv_status::timeout && Clock::now() >= hedge_at) {
+                launch(race, launched, attempts[launched], calls[attempts[launched]]);
+                ++launched;
+                hedged = true;
+            }
+            continue;
+        }
+        if (cancel) race->cv.wait_for(lk, poll);
+        else race->cv.wait(lk);
+    }
+
+    //Проигравшие и ещё не начатые попытки больше не нужны
+    race->abort = true;
+
+    const auto& res = race->results;
+    Route route;
+    route.hedged = hedged;
+    if (winner >= 0) {
+        route.backend = backends_[attempts[winner]].name;
+        route.failover = winner != 0 && res[0].done && !res[0].text;
+        //Страхующий запрос выиграл, пока первый ещё работал
+        route.hedge_won = hedged && winner != 0 && !res[0].done;
+        if (route.hedge_won) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            ++backends_[attempts[winner]].hedge_wins;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        last_ = route;
+    }
+    if (winner >= 0) {
+        //Бэкенд начал отвечать по частям и упал: ответ заменившего его
+        //выводим целиком, иначе пользователь увидит только обрывок
+        const int owner = race->owner.load();
+        if (owner >= 0 && owner != winner && onToken) {
+            lk.unlock();
+            onToken(*res[winner].text);
+        }
+        return res[winner].text;
+    }
+
+    if (cancelled) {
+        if (err) *err = "cancelled";
+        return std::nullopt;
+    }
+    if (err) {
+        err->clear();
+        for (size_t s = 0; s < launched; ++s) {
+            if (!err->empty()) *err += "; ";
+            *err += backends_[attempts[s]].name + ": " + res[s].error;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<BackendRouter::Stats> BackendRouter::stats() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const auto now = Clock::now();
+    std::vector<Stats> out;
+    for (const auto& b : backends_) {
+        Stats s;
+        s.name = b.name;
+        s.requests = b.requests;
+        s.failures = b.failures;
+        s.hedge_wins = b.hedge_wins;
+        s.ewma_ms = b.ewma_ms;
+        s.p95_ms = p95(b);
+        s.error_rate = b.error_rate;
+        if (b.down_until > now) {
+            s.cooldown_left = std::chrono::duration_cast<std::chrono::seconds>(b.down_until - now) +
+                              std::chrono::seconds(1);
+        }
+        out.push_back(std::move(s));
+    }
+    return out;
+}
+
+BackendRouter::Route BackendRouter::lastRoute() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return last_;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+
+//Маршрутизатор запросов между бэкендами модели (удалённый API, llama-server).
+//
+//По каждому бэкенду копится статистика: EWMA задержки успешных ответов,
+//EWMA доли ошибок и окно последних задержек для p95. Запрос идёт в лучший
+//по оценке бэкенд. Ошибка бэкенда сразу переводит запрос на следующий.
+//После нескольких ошибок подряд бэкенд на время выводится из ротации.
+//Если включён hedge и ответа нет дольше p95, параллельно уходит страхующий
+//запрос в следующий бэкенд и берётся первый успешный ответ; проигравшему
+//выставляется флаг abort, и он прерывается.
+class BackendRouter {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TokenCallback = std::function<void(const std::string&)>;
+    //Вызов бэкенда. onToken пуст, если ответ не нужен по частям; abort
+    //становится true, когда ответ больше не нужен — вызов должен прерваться
+    using Call = std::function<std::optional<std::string>(const TokenCallback& onToken,
+        const std::atomic<bool>& abort, std::string* err)>;
+
+    struct Options {
+        bool failover = true;
+        //Страховать медленный запрос вторым бэкендом. Выключено по умолчанию:
+        //запрос уходит не туда, куда выбрал пользователь
+        bool hedge = false;
+        //Ставить первым заметно более быстрый бэкенд вместо выбранного.
+        //Выключено по той же причине, что и hedge
+        bool prefer_fastest = false;
+        //Задержка хеджа, пока у бэкенда мало замеров для p95
+        std::chrono::milliseconds hedge_default{3000};
+        std::chrono::milliseconds hedge_min{200};
+        //Столько ошибок подряд выводят бэкенд из ротации
+        int max_consecutive_failures = 3;
+        std::chrono::seconds cooldown{30};
+    };
+
+    //Снимок статистики бэкенда для --model-info
+    struct Stats {
+        std::string name;
+        size_t requests = 0;
+        size_t failures = 0;
+        size_t hedge_wins = 0;     //ответил быстрее, будучи страхующим
+        double ewma_ms = 0;
+        double p95_ms = 0;
+        double error_rate = 0;
+        //Сколько ещё бэкенд вне ротации; 0 — доступен
+        std::chrono::seconds cooldown_left{0};
+    };
+
+    //Как был обслужен последний запрос
+    struct Route {
+        std::string backend;       //кто ответил; пусто — никто
+        bool hedged = false;       //был ли отправлен страхующий запрос
+        bool hedge_won = false;    //страхующий ответил раньше первого
+        bool failover = false;     //первый выбранный бэкенд ответил ошибкой
+    };
+
+    explicit BackendRouter(std::vector<std::string> names);
+    //Ждёт запросы, проигравшие гонку (они держат ссылки на агента);
+    //им уже выставлен abort, так что ожидание короткое
+    ~BackendRouter();
+
+    BackendRouter(const BackendRouter&) = delete;
+    BackendRouter& operator=(const BackendRouter&) = delete;
+
+    void setOptions(const Options& opts);
+
+    //Выполнить запрос. calls[i] — вызов i-го бэкенда (пустой — бэкенд для
+    //этого запроса недоступен), preferred — бэкенд, выбранный пользователем:
+    //он идёт первым, пока не заметно хуже остальных.
+    //onToken получает текст только от одного бэкенда — того, кто начал
+    //отвечать первым. cancel, если задан, прерывает запрос целиком:
+    //run() возвращает ошибку "cancelled", запущенные вызовы получают abort
+    std::optional<std::string> run(const std::vector<Call>& calls, size_t preferred,
+        const TokenCallback& onToken, std::string* err = nullptr,
+        const std::atomic<bool>* cancel = nullptr);
+
+    std::vector<Stats> stats() const;
+    Route lastRoute() const;
+
+private:
+    static constexpr double kAlpha = 0.2;         //вес нового замера в EWMA
+    static constexpr size_t kWindow = 64;         //замеров для p95
+    static constexpr size_t kMinSamples = 8;      //меньше — p95 не считаем
+    //Во сколько раз предпочтённый бэкенд может быть медленнее лучшего
+    static constexpr double kStickiness = 2.0;
+    static constexpr size_t kProbeEvery = 16;
+
+    struct Backend {
+        std::string name;
+        size_t requests = 0;
+        size_t failures = 0;
+        size_t hedge_wins = 0;
+        double ewma_ms = 0;
+        double error_rate = 0;
+        int consecutive_failures = 0;
+        std::deque<double> window;
+        Clock::time_point down_until{};
+    };
+
+    struct Race;
+
+    //Порядок попыток: доступные по оценке, выведенные из ротации — в конце
+    std::vector<size_t> order(const std::vector<Call>& calls, size_t preferred) const;
+    //Ожидаемая задержка с учётом ошибок; без замеров — 0
+    static double score(const Backend& b);
+    static double p95(const Backend& b);
+    std::chrono::milliseconds hedgeDelay(size_t i) const;
+    void record(size_t i, bool ok, double ms);
+    void launch(const std::shared_ptr<Race>& race, size_t slot, size_t backend, const Call& call);
+
+    mutable std::mutex mtx_;
+    Options opts_;
+    std::vector<Backend> backends_;
+    Route last_;
+    size_t runs_ = 0;
+    //Запросы, ответ которых уже не нужен: дожидаемся их, не блокируя run()
+    std::vector<std::future<void>> stragglers_;
+};
@@ -0,0 +1,297 @@
+#include "ContextStore.h"
+#include <iostream>
+#include <ctime>
+#include <algorithm>
+#include <chrono>
+
+ContextStore::ContextStore(size_t capacity) : ring_(capacity ? capacity : 1) {}
+
+ContextStore::~ContextStore() {
+    close();
+}
+
+std::string ContextStore::nowTimestamp() {
+    //Тот же формат и часовой пояс (UTC), что у CURRENT_TIMESTAMP в SQLite
+    std::time_t t = std::time(nullptr);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+bool ContextStore::open(const std::string& dbPath, const std::string& session, std::string* err) {
+    close();
+    session_ = session;
+
+    if (sqlite3_open(dbPath.c_str(), &db_) != SQLITE_OK) {
+        if (err) *err = std::string("Cannot open database: ") + sqlite3_errmsg(db_);
+        sqlite3_close(db_);
+        db_ = nullptr;
+        return false;
+    }
+    //Занятая другим процессом база — ждём, а не сразу SQLITE_BUSY
+    sqlite3_busy_timeout(db_, kBusyTimeoutMs);
+    //WAL: запись не блокирует чтение и не требует fsync на каждый коммит;
+    //при synchronous=NORMAL fsync делается только на чекпоинтах
+    sqlite3_exec(db_, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+    sqlite3_exec(db_, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+
+    const char* schema = "CREATE TABLE IF NOT EXISTS chat_history ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "session_id TEXT NOT NULL,"
+        "role TEXT NOT NULL,"
+        "content TEXT NOT NULL,"
+        "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_session ON chat_history(session_id);"
+        "CREATE INDEX IF NOT EXISTS idx_timestamp ON chat_history(timestamp);";
+
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db_, schema, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        if (err) *err = std::string("SQL error: ") + (errMsg ? errMsg : "");
+        sqlite3_free(errMsg);
+        close();
+        return false;
+    }
+
+    const char* insert_sql = "INSERT INTO chat_history (session_id, role, content, timestamp) VALUES (?, ?, ?, ?)";
+    const char* history_sql = "SELECT role, content, timestamp FROM chat_history WHERE session_id = ? ORDER BY timestamp DESC, id DESC LIMIT ?";
+    const char* clear_sql = "DELETE FROM chat_history WHERE session_id = ?";
+    if (sqlite3_prepare_v2(db_, insert_sql, -1, &insert_stmt_, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db_, history_sql, -1, &history_stmt_, nullptr) != SQLITE_OK ||
+        sqlite3_prepare_v2(db_, clear_sql, -1, &clear_stmt_, nullptr) != SQLITE_OK) {
+        if (err) *err = std::string("Failed to prepare statement: ") + sqlite3_errmsg(db_);
+        close();
+        return false;
+    }
+
+    //Подгружаем хвост истории, чтобы первые промпты тоже собирались из памяти
+    auto tail = loadFromDb(ring_.size());
+    //Сообщений в базе может быть больше, чем влезло в буфер: тогда recent()
+    //с большим limit должен читать базу
+    const size_t stored = countInDb();
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        head_ = size_ = total_ = 0;
+        for (auto& msg : tail) pushLocked(std::move(msg));
+        total_ = std::max(total_, stored);
+        stop_ = false;
+    }
+
+    writer_ = std::thread(&ContextStore::writerLoop, this);
+    return true;
+}
+
+void ContextStore::close() {
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        //Писатель выходит, только опустошив очередь
+        writer_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(db_mtx_);
+    //sqlite3_finalize(nullptr) безопасен
+    sqlite3_finalize(insert_stmt_);
+    sqlite3_finalize(history_stmt_);
+    sqlite3_finalize(clear_stmt_);
+    insert_stmt_ = history_stmt_ = clear_stmt_ = nullptr;
+    if (db_) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+    }
+}
+
+void ContextStore::pushLocked(ChatMessage msg) {
+    const size_t cap = ring_.size();
+    if (size_ < cap) {
+        ring_[(head_ + size_) % cap] = std::move(msg);
+        ++size_;
+    } else {
+        //Буфер полон — затираем самое старое
+        ring_[head_] = std::move(msg);
+        head_ = (head_ + 1) % cap;
+    }
+    ++total_;
+}
+
+void ContextStore::append(const std::string& role, const std::string& content) {
+    ChatMessage msg{role, content, nowTimestamp()};
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        pushLocked(msg);
+        pending_.push_back(std::move(msg));
+    }
+    cv_.notify_one();
+}
+
+void ContextStore::appendExchange(const std::string& user, const std::string& assistant) {
+    const std::string ts = nowTimestamp();
+    {
+        //Пара кладётся в очередь целиком, поэтому и пишется одной транзакцией
+        std::lock_guard<std::mutex> lock(mtx_);
+        pushLocked({"user", user, ts});
+        pushLocked({"assistant", assistant, ts});
+        pending_.push_back({"user", user, ts});
+        pending_.push_back({"assistant", assistant, ts});
+    }
+    cv_.notify_one();
+}
+
+std::vector<ChatMessage> ContextStore::recent(size_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        //Буфер содержит всю нужную часть истории — диск не трогаем
+        if (limit <= size_ || size_ == total_) {
+            const size_t n = std::min(limit, size_);
+            std::vector<ChatMessage> out;
+            out.reserve(n);
+            for (size_t i = size_ - n; i < size_; ++i) {
+                out.push_back(ring_[(head_ + i) % ring_.size()]);
+            }
+            return out;
+        }
+    }
+    flush();
+    return loadFromDb(limit);
+}
+
+std::vector<ChatMessage> ContextStore::loadFromDb(size_t limit) {
+    std::vector<ChatMessage> history;
+    std::lock_guard<std::mutex> lock(db_mtx_);
+    if (!history_stmt_) return history;
+
+    sqlite3_stmt* stmt = history_stmt_;
+    sqlite3_bind_text(stmt, 1, session_.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)limit);
+
+    int step_result;
+    while ((step_result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ChatMessage msg;
+        const char* role_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* content_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* timestamp_ptr = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+
+        if (role_ptr) msg.role = role_ptr;
+        if (content_ptr) msg.content = content_ptr;
+        if (timestamp_ptr) msg.timestamp = timestamp_ptr;
+
+        history.push_back(std::move(msg));
+    }
+
+    if (step_result != SQLITE_DONE) {
+        std::cerr << "Error reading context: " << sqlite3_errmsg(db_) << std::endl;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    //Переворачиваем чтобы получить в хронологическом порядке
+    std::reverse(history.begin(), history.end());
+    return history;
+}
+
+size_t ContextStore::countInDb() {
+    std::lock_guard<std::mutex> lock(db_mtx_);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM chat_history WHERE session_id = ?",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, session_.c_str(), -1, SQLITE_STATIC);
+    const size_t count = sqlite3_step(stmt) == SQLITE_ROW ? (size_t)sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+bool ContextStore::clear() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    //Неписаные сообщения тоже отбрасываем, а текущую пачку писателя дожидаемся
+    pending_.clear();
+    idle_cv_.wait(lock, [this] { return !writing_; });
+    //Неудачная пачка могла вернуться в очередь, пока мы ждали
+    pending_.clear();
+    head_ = size_ = total_ = 0;
+    lock.unlock();
+
+    std::lock_guard<std::mutex> db_lock(db_mtx_);
+    if (!clear_stmt_) return false;
+    sqlite3_bind_text(clear_stmt_, 1, session_.c_str(), -1, SQLITE_STATIC);
+    const bool success = sqlite3_step(clear_stmt_) == SQLITE_DONE;
+    sqlite3_reset(clear_stmt_);
+    sqlite3_clear_bindings(clear_stmt_);
+    return success;
+}
+
+void ContextStore::flush() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    idle_cv_.wait(lock, [this] { return pending_.empty() && !writing_; });
+}
+
+void ContextStore::writerLoop() {
+    std::vector<ChatMessage> batch;
+    int attempts = 0;
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (pending_.empty()) break;   //stop_ и писать нечего
+
+        //Забираем всё накопленное одной пачкой
+        batch.clear();
+        batch.swap(pending_);
+        writing_ = true;
+        lock.unlock();
+
+        const bool ok = writeBatch(batch);
+        if (!ok && ++attempts < kMaxWriteAttempts) {
+            //Пауза растёт с каждой попыткой: 100, 200, 400 мс
+            std::this_thread::sleep_for(std::chrono::milliseconds(100 << (attempts - 1)));
+        }
+
+        lock.lock();
+        if (ok) {
+            attempts = 0;
+        } else if (attempts < kMaxWriteAttempts) {
+            //Пачку — обратно в начало очереди, перед принятым за это время
+            pending_.insert(pending_.begin(), std::make_move_iterator(batch.begin()),
+                            std::make_move_iterator(batch.end()));
+        } else {
+            std::cerr << "Context: " << batch.size() << " message(s) not saved after "
+                      << attempts << " attempts" << std::endl;
+            attempts = 0;
+        }
+        writing_ = false;
+        idle_cv_.notify_all();
+    }
+}
+
+bool ContextStore::writeBatch(const std::vector<ChatMessage>& batch) {
+    std::lock_guard<std::mutex> lock(db_mtx_);
+    if (!insert_stmt_) return false;
+
+    sqlite3_exec(db_, "BEGIN", nullptr, nullptr, nullptr);
+    for (const auto& msg : batch) {
+        sqlite3_bind_text(insert_stmt_, 1, session_.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_stmt_, 2, msg.role.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_stmt_, 3, msg.content.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_stmt_, 4, msg.timestamp.c_str(), -1, SQLITE_STATIC);
+        const int rc = sqlite3_step(insert_stmt_);
+        sqlite3_reset(insert_stmt_);
+        sqlite3_clear_bindings(insert_stmt_);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Failed to save to context: " << sqlite3_errmsg(db_) << std::endl;
+            sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+            return false;
+        }
+    }
+    if (sqlite3_exec(db_, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to save to context: " << sqlite3_errmsg(db_) << std::endl;
+        sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+        return false;
+    }
+    return true;
+}
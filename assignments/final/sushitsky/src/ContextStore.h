@@ -0,0 +1,87 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sqlite3.h>
+
+//Структура для хранения истории сообщений
+struct ChatMessage {
+    std::string role;    //"user" или "assistant"
+    std::string content;
+    std::string timestamp;
+};
+
+//Хранилище истории одной сессии.
+//Последние сообщения держатся в кольцевом буфере в памяти, и промпт собирается
+//без обращения к диску. Запись в SQLite (chat_history) идёт фоновым потоком
+//пачками, по транзакции на пачку. Неудачная пачка (например, база занята
+//другим процессом) возвращается в начало очереди и повторяется до
+//kMaxWriteAttempts раз; только после этого сообщения теряются с сообщением
+//в stderr. close() дописывает всё принятое до выхода.
+class ContextStore {
+public:
+    explicit ContextStore(size_t capacity = 32);
+    ~ContextStore();
+
+    ContextStore(const ContextStore&) = delete;
+    ContextStore& operator=(const ContextStore&) = delete;
+
+    //Открыть базу, подгрузить хвост истории сессии в буфер и запустить запись
+    bool open(const std::string& dbPath, const std::string& session, std::string* err = nullptr);
+    //Дописать очередь на диск и закрыть базу
+    void close();
+    bool isOpen() const { return db_ != nullptr; }
+
+    //Принять сообщения: сразу видны в recent(), на диск попадут позже
+    void append(const std::string& role, const std::string& content);
+    void appendExchange(const std::string& user, const std::string& assistant);
+
+    //Последние limit сообщений в хронологическом порядке.
+    //Если буфера не хватает — дописываем очередь и читаем из базы
+    std::vector<ChatMessage> recent(size_t limit);
+
+    //Удалить историю сессии (и из памяти, и из базы)
+    bool clear();
+
+    //Дождаться, пока всё принятое будет записано
+    void flush();
+
+private:
+    static constexpr int kMaxWriteAttempts = 4;
+    static constexpr int kBusyTimeoutMs = 2000;
+
+    void pushLocked(ChatMessage msg);
+    void writerLoop();
+    bool writeBatch(const std::vector<ChatMessage>& batch);
+    std::vector<ChatMessage> loadFromDb(size_t limit);
+    size_t countInDb();
+
+    static std::string nowTimestamp();
+
+private:
+    std::string session_;
+    sqlite3* db_ = nullptr;
+    sqlite3_stmt* insert_stmt_ = nullptr;
+    sqlite3_stmt* history_stmt_ = nullptr;
+    sqlite3_stmt* clear_stmt_ = nullptr;
+    //Соединение используется и писателем, и чтением/очисткой
+    std::mutex db_mtx_;
+
+    //Кольцевой буфер: ring_[(head_ + i) % capacity] — i-е по старшинству
+    std::vector<ChatMessage> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    //Сколько сообщений сессии вообще есть (буфер может хранить не все)
+    size_t total_ = 0;
+
+    //Очередь на запись
+    std::vector<ChatMessage> pending_;
+    bool writing_ = false;
+    bool stop_ = false;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::thread writer_;
+};
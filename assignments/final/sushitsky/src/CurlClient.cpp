@@ -0,0 +1,107 @@
+#include "CurlClient.h"
+
+namespace {
+// Глобальное состояние libcurl живёт столько же, сколько процесс
+struct CurlGlobal {
+    CurlGlobal() { curl_global_init(CURL_GLOBAL_DEFAULT); }
+    ~CurlGlobal() { curl_global_cleanup(); }
+};
+}
+
+void CurlClient::globalInit() {
+    static CurlGlobal global;
+}
+
+CurlClient::CurlClient() {
+    globalInit();
+    headers_ = curl_slist_append(headers_, "Content-Type: application/json");
+}
+
+CurlClient::~CurlClient() {
+    for (CURL* curl : idle_) curl_easy_cleanup(curl);
+    if (headers_) curl_slist_free_all(headers_);
+}
+
+CURL* CurlClient::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!idle_.empty()) {
+            CURL* curl = idle_.back();
+            idle_.pop_back();
+            return curl;
+        }
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl) return nullptr;
+
+    // Постоянные параметры задаём один раз, они сохраняются между запросами
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers_);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    return curl;
+}
+
+void CurlClient::release(CURL* curl) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    idle_.push_back(curl);
+}
+
+size_t CurlClient::appendToString(void* contents, size_t size, size_t nmemb, void* userdata) {
+    const size_t total_size = size * nmemb;
+    static_cast<std::string*>(userdata)->append(static_cast<char*>(contents), total_size);
+    return total_size;
+}
+
+int CurlClient::checkAbort(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<const std::atomic<bool>*>(clientp)->load() ? 1 : 0;
+}
+
+bool CurlClient::post(const std::string& url, const std::string& body,
+                      WriteFn write, void* userdata, long timeout, std::string* err,
+                      const std::atomic<bool>* abort) {
+    CURL* curl = acquire();
+    if (!curl) {
+        if (err) *err = "curl_easy_init failed";
+        return false;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body.size());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, userdata);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+    // Флаг проверяется в progress-callback, curl зовёт его и при простое
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, abort ? 0L : 1L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, abort ? &CurlClient::checkAbort : nullptr);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, abort);
+
+    const CURLcode res = curl_easy_perform(curl);
+
+    // Тело и приёмник принадлежат вызывающему — не оставляем на них ссылок
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, nullptr);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, nullptr);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, nullptr);
+    release(curl);
+
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        if (err) *err = "cancelled";
+        return false;
+    }
+    if (res != CURLE_OK) {
+        if (err) *err = std::string("curl_easy_perform() failed: ") + curl_easy_strerror(res);
+        return false;
+    }
+    return true;
+}
+
+std::optional<std::string> CurlClient::post(const std::string& url, const std::string& body,
+                                            long timeout, std::string* err,
+                                            const std::atomic<bool>* abort) {
+    std::string response;
+    if (!post(url, body, appendToString, &response, timeout, err, abort)) return std::nullopt;
+    return response;
+}
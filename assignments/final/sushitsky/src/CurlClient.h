@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <optional>
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+#include <curl/curl.h>
+
+// Долгоживущий HTTP-клиент поверх CURL easy-handle.
+// Handle не пересоздаётся между запросами, поэтому curl сохраняет
+// keep-alive соединения, DNS-кэш и TLS-сессии к серверу.
+// Клиент можно звать из нескольких потоков: свободные handle лежат в стеке,
+// при одновременных запросах создаётся ещё один, и после запроса он тоже остаётся.
+class CurlClient {
+public:
+    // Приёмник тела ответа в формате CURLOPT_WRITEFUNCTION
+    using WriteFn = size_t (*)(void* contents, size_t size, size_t nmemb, void* userdata);
+
+    CurlClient();
+    ~CurlClient();
+
+    CurlClient(const CurlClient&) = delete;
+    CurlClient& operator=(const CurlClient&) = delete;
+
+    // curl_global_init ровно один раз на процесс (cleanup — при его завершении)
+    static void globalInit();
+
+    // POST JSON-тела; ответ по частям отдаётся в write(userdata).
+    // timeout — предельное время запроса в секундах; abort (если задан)
+    // прерывает запрос, как только станет true
+    bool post(const std::string& url, const std::string& body,
+              WriteFn write, void* userdata, long timeout, std::string* err = nullptr,
+              const std::atomic<bool>* abort = nullptr);
+
+    // То же, но тело ответа собирается в строку
+    std::optional<std::string> post(const std::string& url, const std::string& body,
+                                    long timeout, std::string* err = nullptr,
+                                    const std::atomic<bool>* abort = nullptr);
+
+private:
+    static size_t appendToString(void* contents, size_t size, size_t nmemb, void* userdata);
+    // CURLOPT_XFERINFOFUNCTION: ненулевой ответ прерывает передачу
+    static int checkAbort(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+
+    // Взять свободный handle (или создать новый) и вернуть его обратно
+    CURL* acquire();
+    void release(CURL* curl);
+
+private:
+    std::mutex mtx_;
+    std::vector<CURL*> idle_;
+    curl_slist* headers_ = nullptr;
+};
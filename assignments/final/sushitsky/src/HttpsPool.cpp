@@ -0,0 +1,230 @@
+#include "HttpsPool.h"
+#include <sstream>
+#include <algorithm>
+#include <climits>
+
+#include <openssl/err.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+// --------- жизненный цикл пула ----------
+HttpsPool::HttpsPool() {
+    // Инициализируем OpenSSL заранее, а не на первом запросе
+    TlsContext::instance();
+}
+
+HttpsPool::~HttpsPool() {
+    for (auto& [key, conns] : idle_) {
+        for (auto& c : conns) closeConnection(c);
+    }
+    idle_.clear();
+}
+
+void HttpsPool::closeConnection(Connection& c) {
+    if (c.ssl) {
+        SSL_shutdown(c.ssl);
+        SSL_free(c.ssl);
+        c.ssl = nullptr;
+    }
+    if (c.sock >= 0) {
+        close(c.sock);
+        c.sock = -1;
+    }
+}
+
+// Живое простаивающее соединение не должно быть читаемым:
+// данные или EOF означают, что сервер его закрыл (или прислал мусор)
+bool HttpsPool::isAlive(const Connection& c) {
+    if (!c.ssl || c.sock < 0) return false;
+    if (SSL_pending(c.ssl) > 0) return false;
+    pollfd p{c.sock, POLLIN, 0};
+    const int r = poll(&p, 1, 0);
+    return r == 0;
+}
+
+// -------- открытие нового TLS-соединения --------
+bool HttpsPool::openConnection(const std::string& host, const std::string& port,
+                               Connection& c, std::string* err) {
+    TlsContext& tls = TlsContext::instance();
+    if (!tls.ctx()) { if (err) *err = "SSL_CTX_new failed"; return false; }
+
+    c.sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (c.sock < 0) { if (err) *err = "socket failed"; return false; }
+
+    struct addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+        if (err) *err = "getaddrinfo failed";
+        closeConnection(c); return false;
+    }
+
+    if (::connect(c.sock, res->ai_addr, res->ai_addrlen) < 0) {
+        if (err) *err = "connect failed";
+        freeaddrinfo(res); closeConnection(c); return false;
+    }
+    freeaddrinfo(res);
+
+    const std::string key = host + ":" + port;
+    c.ssl = SSL_new(tls.ctx());
+    SSL_set_fd(c.ssl, c.sock);
+    SSL_set_tlsext_host_name(c.ssl, host.c_str());
+    // Если есть сохранённая сессия — рукопожатие будет сокращённым
+    tls.prepare(c.ssl, key);
+    if (SSL_connect(c.ssl) <= 0) {
+        if (err) *err = "SSL_connect failed";
+        tls.forget(key);
+        closeConnection(c); return false;
+    }
+    tls.onHandshake(c.ssl);
+    return true;
+}
+
+// -------- работа с простаивающими соединениями --------
+std::optional<HttpsPool::Connection> HttpsPool::takeIdle(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = idle_.find(key);
+    if (it == idle_.end()) return std::nullopt;
+
+    auto& conns = it->second;
+    const auto now = std::chrono::steady_clock::now();
+    // Берём самое свежее соединение, протухшие и закрытые сервером выбрасываем
+    while (!conns.empty()) {
+        Connection c = conns.back();
+        conns.pop_back();
+        if (now - c.last_used < idle_timeout_ && isAlive(c)) return c;
+        closeConnection(c);
+    }
+    return std::nullopt;
+}
+
+void HttpsPool::putIdle(const std::string& key, Connection c) {
+    c.last_used = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& conns = idle_[key];
+    if (max_idle_per_host_ == 0) { closeConnection(c); return; }
+    if (conns.size() >= max_idle_per_host_) {
+        // Вытесняем самое старое
+        closeConnection(conns.front());
+        conns.erase(conns.begin());
+    }
+    conns.push_back(c);
+}
+
+// -------- один запрос/ответ по соединению --------
+void HttpsPool::setReadTimeout(const Connection& c, std::chrono::milliseconds t) {
+    timeval tv{};
+    tv.tv_sec = t.count() / 1000;
+    tv.tv_usec = (t.count() % 1000) * 1000;
+    setsockopt(c.sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+std::optional<HttpResponse> HttpsPool::roundTrip(Connection& c, const std::string& request,
+                                                 bool& keepAlive, bool& nothingRead,
+                                                 std::string* err, const std::atomic<bool>* abort) {
+    keepAlive = false;
+    nothingRead = false;
+
+    if (SSL_write(c.ssl, request.c_str(), (int)request.size()) <= 0) {
+        nothingRead = true;
+        if (err) *err = "SSL_write failed";
+        return std::nullopt;
+    }
+
+    // Соединение из пула могло остаться с таймаутом от прошлого запроса
+    setReadTimeout(c, std::chrono::milliseconds(abort ? 100 : 0));
+
+    HttpResponseParser parser;
+    char chunk[4096];
+    bool anything = false, extra = false;
+    while (!parser.done() && !parser.failed()) {
+        size_t room = 0;
+        int n;
+        if (char* dst = parser.bodySpace(room)) {
+            // Тело читаем прямо в буфер ответа
+            n = SSL_read(c.ssl, dst, (int)std::min<size_t>(room, INT_MAX));
+            if (n > 0) parser.commitBody(n);
+        } else {
+            // Статус, заголовки и служебные строки chunked — через небольшой буфер
+            n = SSL_read(c.ssl, chunk, sizeof(chunk));
+            if (n > 0 && parser.feed(chunk, n) < (size_t)n) extra = true;
+        }
+        if (n <= 0 && abort && SSL_get_error(c.ssl, n) == SSL_ERROR_WANT_READ) {
+            // Истёк таймаут чтения, а не соединение
+            if (abort->load()) {
+                if (err) *err = "cancelled";
+                return std::nullopt;
+            }
+            continue;
+        }
+        if (n <= 0) {
+            parser.onEof();
+            break;
+        }
+        anything = true;
+    }
+
+    if (parser.failed()) {
+        nothingRead = !anything;
+        if (err) *err = parser.error();
+        return std::nullopt;
+    }
+
+    HttpResponse resp;
+    resp.status = parser.status();
+    resp.data = parser.takeBody();
+    // Лишние байты после ответа — соединение в непонятном состоянии, не переиспользуем
+    keepAlive = parser.keepAlive() && !extra;
+    return resp;
+}
+
+// -------- POST через пул --------
+std::optional<HttpResponse> HttpsPool::post(const std::string& host, const std::string& port,
+                                            const std::string& path, const std::string& extraHeaders,
+                                            const std::string& body, std::string* err,
+                                            const std::atomic<bool>* abort) {
+    std::ostringstream req;
+    req << "POST " << path << " HTTP/1.1\r\n"
+        << "Host: " << host << "\r\n"
+        << "Content-Type: application/json\r\n"
+        << "Connection: keep-alive\r\n"
+        << extraHeaders
+        << "Content-Length: " << body.size() << "\r\n\r\n"
+        << body;
+    const std::string request_str = req.str();
+    const std::string key = host + ":" + port;
+    if (abort && abort->load()) {
+        if (err) *err = "cancelled";
+        return std::nullopt;
+    }
+
+    // Вторая попытка нужна, если сервер успел закрыть переиспользованное соединение
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        Connection c;
+        bool reused = false;
+        if (auto idle = takeIdle(key)) {
+            c = *idle;
+            reused = true;
+        } else if (!openConnection(host, port, c, err)) {
+            return std::nullopt;
+        }
+
+        bool keepAlive = false, nothingRead = false;
+        auto resp = roundTrip(c, request_str, keepAlive, nothingRead, err, abort);
+        if (!resp) {
+            closeConnection(c);
+            if (reused && nothingRead) continue;
+            return std::nullopt;
+        }
+
+        if (keepAlive) putIdle(key, c);
+        else closeConnection(c);
+        return resp;
+    }
+
+    if (err) *err = "connection closed by server";
+    return std::nullopt;
+}
@@ -0,0 +1,273 @@
+#include "LlamaBackend.h"
+#include <mutex>
+
+#ifdef HAVE_LLAMA_LIB
+#include <llama.h>
+#include <algorithm>
+#include <thread>
+#endif
+
+#ifdef HAVE_LLAMA_LIB
+
+struct LlamaBackend::Impl {
+    Options opts;
+    llama_model* model = nullptr;
+    llama_context* ctx = nullptr;
+    const llama_vocab* vocab = nullptr;
+    const char* chat_template = nullptr;
+    std::vector<llama_token> cached;   //токены, чьё состояние лежит в KV-кэше
+    size_t reused = 0;
+    std::mutex mtx;
+
+    ~Impl() {
+        if (ctx) llama_free(ctx);
+        if (model) llama_model_free(model);
+    }
+
+    //BOS и прочие служебные токены уже расставлены шаблоном чата, поэтому
+    //add_special=false (иначе BOS задвоится); parse_special=true, чтобы
+    //маркеры шаблона стали токенами, а не текстом
+    bool tokenize(const std::string& text, std::vector<llama_token>& out, std::string* err) {
+        const int n = -llama_tokenize(vocab, text.data(), (int32_t)text.size(), nullptr, 0, false, true);
+        out.resize(n);
+        if (llama_tokenize(vocab, text.data(), (int32_t)text.size(), out.data(), n, false, true) < 0) {
+            if (err) *err = "llama_tokenize failed";
+            return false;
+        }
+        return true;
+    }
+
+    bool applyTemplate(const std::vector<Message>& messages, std::string& out, std::string* err) {
+        std::vector<llama_chat_message> chat;
+        chat.reserve(messages.size());
+        for (const auto& m : messages) chat.push_back({m.role.c_str(), m.content.c_str()});
+
+        size_t total = 0;
+        for (const auto& m : messages) total += m.role.size() + m.content.size();
+        std::vector<char> buf(total * 2 + 256);
+        int n = llama_chat_apply_template(chat_template, chat.data(), chat.size(), true,
+                                          buf.data(), (int32_t)buf.size());
+        if (n > (int)buf.size()) {
+            buf.resize(n);
+            n = llama_chat_apply_template(chat_template, chat.data(), chat.size(), true,
+                                          buf.data(), (int32_t)buf.size());
+        }
+        if (n < 0) {
+            if (err) *err = "llama_chat_apply_template failed";
+            return false;
+        }
+        out.assign(buf.data(), n);
+        return true;
+    }
+
+    //Досчитать токены [from, tokens.size()) пачками по n_batch
+    bool decode(std::vector<llama_token>& tokens, size_t from, std::string* err) {
+        const size_t n_batch = llama_n_batch(ctx);
+        for (size_t i = from; i < tokens.size(); i += n_batch) {
+            const size_t n = std::min(n_batch, tokens.size() - i);
+            if (llama_decode(ctx, llama_batch_get_one(tokens.data() + i, (int32_t)n)) != 0) {
+                if (err) *err = "llama_decode failed";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+bool LlamaBackend::available() { return true; }
+
+bool LlamaBackend::load(const Options& opts, std::string* err) {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    if (impl_->ctx) return true;
+    if (opts.model_path.empty()) {
+        if (err) *err = "local_model_path is not set";
+        return false;
+    }
+    static std::once_flag backend_init;
+    std::call_once(backend_init, [] { llama_backend_init(); });
+
+    impl_->opts = opts;
+    llama_model_params mparams = llama_model_default_params();
+    mparams.use_mmap = true;
+    impl_->model = llama_model_load_from_file(opts.model_path.c_str(), mparams);
+    if (!impl_->model) {
+        if (err) *err = "Cannot load model: " + opts.model_path;
+        return false;
+    }
+
+    const int threads = opts.n_threads > 0 ? opts.n_threads
+        : (int)std::max(1u, std::thread::hardware_concurrency());
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx = opts.n_ctx;
+    cparams.n_batch = std::min(opts.n_ctx, 2048);
+    cparams.n_threads = threads;
+    cparams.n_threads_batch = threads;
+    impl_->ctx = llama_init_from_model(impl_->model, cparams);
+    if (!impl_->ctx) {
+        if (err) *err = "Cannot create llama context";
+        llama_model_free(impl_->model);
+        impl_->model = nullptr;
+        return false;
+    }
+    impl_->vocab = llama_model_get_vocab(impl_->model);
+    impl_->chat_template = llama_model_chat_template(impl_->model, nullptr);
+    return true;
+}
+
+bool LlamaBackend::loaded() const {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->ctx != nullptr;
+}
+
+size_t LlamaBackend::lastReusedTokens() const {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    return impl_->reused;
+}
+
+std::optional<std::string> LlamaBackend::chat(const std::vector<Message>& messages,
+        const TokenCallback& onToken, std::string* err, const std::atomic<bool>* abort) {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    if (!impl_->ctx) {
+        if (err) *err = "Model is not loaded";
+        return std::nullopt;
+    }
+    auto& im = *impl_;
+
+    std::string prompt;
+    std::vector<llama_token> tokens;
+    if (!im.applyTemplate(messages, prompt, err) || !im.tokenize(prompt, tokens, err)) {
+        return std::nullopt;
+    }
+    if (tokens.empty()) {
+        if (err) *err = "Empty prompt after tokenization";
+        return std::nullopt;
+    }
+    if (tokens.size() + im.opts.max_tokens > llama_n_ctx(im.ctx)) {
+        if (err) *err = "Prompt does not fit into local_model_n_ctx";
+        return std::nullopt;
+    }
+
+    //Общий префикс с тем, что уже в KV-кэше, не пересчитываем. Последний
+    //токен промпта считается всегда: от него нужны логиты для первого шага
+    size_t keep = 0;
+    while (keep < im.cached.size() && keep < tokens.size() && im.cached[keep] == tokens[keep]) ++keep;
+    if (!tokens.empty() && keep == tokens.size()) --keep;
+    llama_memory_seq_rm(llama_get_memory(im.ctx), 0, (llama_pos)keep, -1);
+    im.cached.resize(keep);
+    im.reused = keep;
+
+    if (!im.decode(tokens, keep, err)) {
+        llama_memory_clear(llama_get_memory(im.ctx), true);
+        im.cached.clear();
+        return std::nullopt;
+    }
+    im.cached = tokens;
+
+    llama_sampler* smpl = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    llama_sampler_chain_add(smpl, llama_sampler_init_top_p(im.opts.top_p, 1));
+    llama_sampler_chain_add(smpl, llama_sampler_init_temp(im.opts.temperature));
+    llama_sampler_chain_add(smpl, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+
+    std::string answer;
+    char piece[256];
+    for (int i = 0; i < im.opts.max_tokens; ++i) {
+        //Всё посчитанное уже в im.cached, так что прерваться можно в любой момент
+        if (abort && abort->load()) {
+            llama_sampler_free(smpl);
+            if (err) *err = "cancelled";
+            return std::nullopt;
+        }
+        llama_token tok = llama_sampler_sample(smpl, im.ctx, -1);
+        if (llama_vocab_is_eog(im.vocab, tok)) break;
+        const int n = llama_token_to_piece(im.vocab, tok, piece, sizeof(piece), 0, false);
+        if (n > 0) {
+            answer.append(piece, n);
+            if (onToken) onToken(std::string(piece, n));
+        }
+        //Ответ тоже остаётся в кэше: на следующем ходу он станет частью истории
+        im.cached.push_back(tok);
+        if (llama_decode(im.ctx, llama_batch_get_one(&im.cached.back(), 1)) != 0) {
+            llama_sampler_free(smpl);
+            if (err) *err = "llama_decode failed";
+            return std::nullopt;
+        }
+    }
+    llama_sampler_free(smpl);
+    return answer;
+}
+
+bool LlamaBackend::saveState(const std::string& path, std::string* err) {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    auto& im = *impl_;
+    if (!im.ctx || im.cached.empty()) {
+        if (err) *err = "Nothing to save";
+        return false;
+    }
+    //После сбоя llama_decode токены могут обогнать кэш:
+    //в снимок идёт только то, что реально в нём лежит
+    const size_t n = (size_t)llama_memory_seq_pos_max(llama_get_memory(im.ctx), 0) + 1;
+    if (n < im.cached.size()) im.cached.resize(n);
+    if (llama_state_seq_save_file(im.ctx, path.c_str(), 0, im.cached.data(), im.cached.size()) == 0) {
+        if (err) *err = "Cannot save KV cache: " + path;
+        return false;
+    }
+    return true;
+}
+
+bool LlamaBackend::loadState(const std::string& path, std::string* err) {
+    std::lock_guard<std::mutex> lock(impl_->mtx);
+    auto& im = *impl_;
+    if (!im.ctx) {
+        if (err) *err = "Model is not loaded";
+        return false;
+    }
+    llama_memory_clear(llama_get_memory(im.ctx), true);
+    std::vector<llama_token> tokens(llama_n_ctx(im.ctx));
+    size_t n = 0;
+    if (llama_state_seq_load_file(im.ctx, path.c_str(), 0, tokens.data(), tokens.size(), &n) == 0) {
+        llama_memory_clear(llama_get_memory(im.ctx), true);
+        im.cached.clear();
+        if (err) *err = "Cannot load KV cache: " + path;
+        return false;
+    }
+    tokens.resize(n);
+    im.cached = std::move(tokens);
+    return true;
+}
+
+#else
+
+struct LlamaBackend::Impl {};
+
+bool LlamaBackend::available() { return false; }
+
+bool LlamaBackend::load(const Options&, std::string* err) {
+    if (err) *err = "local_lib: agent is built without llama.cpp (configure with -DAI_AGENT_LLAMA_LIB=ON)";
+    return false;
+}
+
+bool LlamaBackend::loaded() const { return false; }
+
+size_t LlamaBackend::lastReusedTokens() const { return 0; }
+
+std::optional<std::string> LlamaBackend::chat(const std::vector<Message>&,
+        const TokenCallback&, std::string* err, const std::atomic<bool>*) {
+    if (err) *err = "local_lib: agent is built without llama.cpp";
+    return std::nullopt;
+}
+
+bool LlamaBackend::saveState(const std::string&, std::string* err) {
+    if (err) *err = "local_lib: agent is built without llama.cpp";
+    return false;
+}
+
+bool LlamaBackend::loadState(const std::string&, std::string* err) {
+    if (err) *err = "local_lib: agent is built without llama.cpp";
+    return false;
+}
+
+#endif
+
+LlamaBackend::LlamaBackend() : impl_(std::make_unique<Impl>()) {}
+
+LlamaBackend::~LlamaBackend() = default;
@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <atomic>
+
+//Встроенный бэкенд local_lib: llama.cpp как библиотека, без HTTP и JSON.
+//Модель (GGUF) загружается один раз через mmap, контекст с KV-кэшем живёт
+//всё время работы агента. Перед генерацией промпт сравнивается с токенами,
+//уже лежащими в кэше, и считаются только новые — при промпте, который
+//растёт в конец (см. PromptLayout), это лишь последняя реплика.
+//
+//Собирается с -DAI_AGENT_LLAMA_LIB=ON. Без неё load() возвращает ошибку.
+class LlamaBackend {
+public:
+    struct Options {
+        std::string model_path;
+        int n_ctx = 4096;
+        int n_threads = 0;      //0 — по числу ядер
+        int max_tokens = 500;
+        float temperature = 0.7f;
+        float top_p = 0.9f;
+    };
+
+    struct Message {
+        std::string role;
+        std::string content;
+    };
+
+    using TokenCallback = std::function<void(const std::string&)>;
+
+    LlamaBackend();
+    ~LlamaBackend();
+
+    LlamaBackend(const LlamaBackend&) = delete;
+    LlamaBackend& operator=(const LlamaBackend&) = delete;
+
+    //Собран ли агент с llama.cpp
+    static bool available();
+
+    //Загрузить модель и создать контекст; повторный вызов ничего не делает
+    bool load(const Options& opts, std::string* err = nullptr);
+    bool loaded() const;
+
+    //Ответ на диалог: сообщения оформляются чат-шаблоном модели.
+    //onToken, если задан, получает текст по мере генерации.
+    //Вызовы сериализуются: контекст один на агента.
+    //abort, если задан, проверяется перед каждым новым токеном ответа
+    std::optional<std::string> chat(const std::vector<Message>& messages,
+        const TokenCallback& onToken, std::string* err = nullptr,
+        const std::atomic<bool>* abort = nullptr);
+
+    //Сколько токенов промпта взято из кэша в последнем вызове
+    size_t lastReusedTokens() const;
+
+    //Снимок KV-кэша вместе с его токенами: сессия, поднятая из снимка,
+    //не пересчитывает уже виденную историю. Снимок другой модели не
+    //загрузится — тогда кэш остаётся пустым
+    bool saveState(const std::string& path, std::string* err = nullptr);
+    bool loadState(const std::string& path, std::string* err = nullptr);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
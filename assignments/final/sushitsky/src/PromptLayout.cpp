@@ -0,0 +1,80 @@
+#include "PromptLayout.h"
+#include <algorithm>
+
+using nlohmann::json;
+
+namespace {
+
+const char* kContextHead = "Контекст предыдущего разговора:\n";
+const char* kContextTail = "Учитывай этот контекст в ответе.\n\n";
+
+bool isSystemTier(PromptLayout::Tier tier) {
+    return tier == PromptLayout::Tier::System || tier == PromptLayout::Tier::Instructions
+        || tier == PromptLayout::Tier::Context;
+}
+
+} // namespace
+
+void PromptLayout::add(Tier tier, std::string content) {
+    segments_.push_back({tier, tier == Tier::Input ? "user" : "system", std::move(content)});
+}
+
+void PromptLayout::addHistory(std::string role, std::string content) {
+    segments_.push_back({Tier::History, std::move(role), std::move(content)});
+}
+
+std::vector<PromptLayout::Segment> PromptLayout::ordered() const {
+    auto out = segments_;
+    std::stable_sort(out.begin(), out.end(), [](const Segment& a, const Segment& b) {
+        return a.tier < b.tier;
+    });
+    return out;
+}
+
+json PromptLayout::messages() const {
+    json messages = json::array();
+    std::string system;
+    for (const auto& seg : ordered()) {
+        if (isSystemTier(seg.tier)) {
+            if (!system.empty()) system += "\n\n";
+            system += seg.content;
+            continue;
+        }
+        if (!system.empty()) {
+            messages.push_back({{"role", "system"}, {"content", std::move(system)}});
+            system.clear();
+        }
+        messages.push_back({{"role", seg.role}, {"content", seg.content}});
+    }
+    if (!system.empty()) messages.push_back({{"role", "system"}, {"content", std::move(system)}});
+    return messages;
+}
+
+std::string PromptLayout::flatten() const {
+    const auto segs = ordered();
+    size_t size = 0;
+    for (const auto& seg : segs) size += seg.content.size() + 16;
+    std::string out;
+    out.reserve(size + 64);
+
+    bool in_history = false;
+    for (const auto& seg : segs) {
+        if (seg.tier == Tier::System) continue;
+        if (seg.tier == Tier::History) {
+            if (!in_history) out += kContextHead;
+            in_history = true;
+            out += seg.role == "user" ? "Пользователь: " : "Ассистент: ";
+            out += seg.content;
+            out += '\n';
+            continue;
+        }
+        if (in_history) {
+            out += kContextTail;
+            in_history = false;
+        }
+        out += seg.content;
+        if (seg.tier != Tier::Input) out += "\n\n";
+    }
+    if (in_history) out += kContextTail;
+    return out;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+//Промпт из сегментов, разложенных от стабильных к изменчивым.
+//llama-server переиспользует KV-кэш для общего префикса соседних запросов,
+//поэтому всё, что не меняется между ходами (системный промпт, инструкции
+//режима, долгоживущий контекст), идёт первым, за ним история (растёт только
+//в конец) и в самом конце новый запрос. Сегменты можно добавлять в любом
+//порядке: раскладка по ярусам делается при сборке.
+class PromptLayout {
+public:
+    enum class Tier {
+        System,        //системный промпт
+        Instructions,  //инструкции режима
+        Context,       //долгоживущий контекст
+        History,       //реплики прошлых ходов
+        Input          //новый запрос пользователя
+    };
+
+    struct Segment {
+        Tier tier;
+        std::string role;     //"system", "user" или "assistant"
+        std::string content;
+    };
+
+    void add(Tier tier, std::string content);
+    void addHistory(std::string role, std::string content);
+
+    bool empty() const { return segments_.empty(); }
+    void clear() { segments_.clear(); }
+
+    //Сегменты по ярусам; внутри яруса — в порядке добавления
+    std::vector<Segment> ordered() const;
+
+    //Сообщения в формате OpenAI: System, Instructions и Context сливаются в одно
+    //system-сообщение, история идёт отдельными репликами, запрос — последним
+    nlohmann::json messages() const;
+
+    //Одна строка для API с единственным полем "prompt". Ярус System сюда
+    //не входит: у такого API системный промпт свой
+    std::string flatten() const;
+
+private:
+    std::vector<Segment> segments_;
+};
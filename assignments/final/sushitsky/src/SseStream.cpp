@@ -0,0 +1,74 @@
+#include "SseStream.h"
+#include <nlohmann/json.hpp>
+
+using nlohmann::json;
+
+size_t SseStream::curlWrite(void* contents, size_t size, size_t nmemb, void* userdata) {
+    const size_t total_size = size * nmemb;
+    static_cast<SseStream*>(userdata)->feed(static_cast<const char*>(contents), total_size);
+    return total_size;
+}
+
+void SseStream::feed(const char* data, size_t size) {
+    pending_.append(data, size);
+
+    // Разбираем только завершённые строки, хвост ждёт следующей порции
+    size_t start = 0, eol;
+    while ((eol = pending_.find('\n', start)) != std::string::npos) {
+        size_t len = eol - start;
+        if (len && pending_[start + len - 1] == '\r') --len;
+        onLine(pending_.substr(start, len));
+        start = eol + 1;
+    }
+    pending_.erase(0, start);
+}
+
+void SseStream::finish() {
+    if (pending_.empty()) return;
+    std::string line;
+    line.swap(pending_);
+    if (line.back() == '\r') line.pop_back();
+    onLine(line);
+}
+
+void SseStream::onLine(const std::string& line) {
+    if (line.empty() || line[0] == ':') return;  // разделитель событий или комментарий
+
+    if (line.compare(0, 5, "data:") != 0) {
+        raw_ += line + "\n";
+        return;
+    }
+
+    size_t p = 5;
+    while (p < line.size() && line[p] == ' ') ++p;
+    const std::string payload = line.substr(p);
+
+    if (payload == "[DONE]") {
+        done_ = true;
+        return;
+    }
+
+    try {
+        auto j = json::parse(payload);
+        if (j.contains("error")) {
+            error_ = j["error"].dump();
+            return;
+        }
+        if (j.contains("choices") && j["choices"].is_array() && !j["choices"].empty()) {
+            const auto& choice = j["choices"][0];
+            if (choice.contains("delta") && choice["delta"].contains("content") &&
+                choice["delta"]["content"].is_string()) {
+                const std::string token = choice["delta"]["content"].get<std::string>();
+                if (!token.empty()) {
+                    text_ += token;
+                    if (on_token_) on_token_(token);
+                }
+            }
+            if (choice.contains("finish_reason") && !choice["finish_reason"].is_null()) {
+                done_ = true;
+            }
+        }
+    } catch (const std::exception&) {
+        raw_ += line + "\n";
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <functional>
+#include <cstddef>
+
+// Инкрементальный разбор потока server-sent events от llama-server
+// (OpenAI-совместимый /v1/chat/completions со "stream": true).
+// Байты скармливаются по мере прихода от curl, на каждый токен
+// вызывается колбэк, а полный ответ копится в text().
+class SseStream {
+public:
+    using TokenCallback = std::function<void(const std::string&)>;
+
+    explicit SseStream(TokenCallback onToken) : on_token_(std::move(onToken)) {}
+
+    // Очередная порция байт из сети (может обрываться посреди строки)
+    void feed(const char* data, size_t size);
+
+    // Готовый CURLOPT_WRITEFUNCTION; userdata — указатель на SseStream
+    static size_t curlWrite(void* contents, size_t size, size_t nmemb, void* userdata);
+
+    // Конец передачи: разбирает последнюю строку без завершающего '\n'
+    // (обычный JSON с ошибкой приходит именно так)
+    void finish();
+
+    bool done() const { return done_; }
+    const std::string& text() const { return text_; }
+    const std::string& error() const { return error_; }
+
+    // Строки вне формата SSE (например, JSON с ошибкой вместо потока)
+    const std::string& raw() const { return raw_; }
+
+private:
+    void onLine(const std::string& line);
+
+private:
+    TokenCallback on_token_;
+    std::string pending_;
+    std::string text_;
+    std::string error_;
+    std::string raw_;
+    bool done_ = false;
+};
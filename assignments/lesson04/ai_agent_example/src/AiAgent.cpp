@@ -4,12 +4,6 @@
 #include <vector>
 #include <cstring>
 
-#include <openssl/ssl.h>
-#include <openssl/err.h>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <unistd.h>
-
 using nlohmann::json;
 
 // --------- utils IO ----------
@@ -60,13 +54,13 @@ bool AiAgent::loadPrompt(const std::string& path, std::string* err) {
 }
 
 // ------- Простейший разбор JSON: ожидаем { "text": "<строка>" } -------
-std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
-    // Если вместе с HTTP-хедерами — отрежем их
+std::string AiAgent::extractTextFromJsonBody(std::string_view body) {
+    // Если вместе с HTTP-хедерами — отрежем их (без копирования тела)
     const auto p = body.find("\r\n\r\n");
-    const std::string json_part = (p != std::string::npos) ? body.substr(p + 4) : body;
+    if (p != std::string_view::npos) body.remove_prefix(p + 4);
 
     try {
-        auto j = json::parse(json_part);
+        auto j = json::parse(body.begin(), body.end());
         return j.at("text").get<std::string>();  // строго ожидаем поле "text"
     } catch (...) {
         return {};
@@ -75,69 +69,16 @@ std::string AiAgent::extractTextFromJsonBody(const std::string& body) {
 
 // -------- Низкоуровневый HTTPS POST на /api/generate --------
 std::optional<std::string> AiAgent::httpsPostGenerate(
-        const AiConfig& cfg, const std::string& jsonBody, std::string* err) {
-    SSL_library_init();
-    SSL_load_error_strings();
-    OpenSSL_add_all_algorithms();
-
-    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
-    if (!ctx) { if (err) *err = "SSL_CTX_new failed"; return std::nullopt; }
-
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) { if (err) *err = "socket failed"; SSL_CTX_free(ctx); return std::nullopt; }
-
-    struct addrinfo hints = {}, *res = nullptr;
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(cfg.host.c_str(), cfg.port.c_str(), &hints, &res) != 0) {
-        if (err) *err = "getaddrinfo failed";
-        close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    if (connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
-        if (err) *err = "connect failed";
-        freeaddrinfo(res); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-    freeaddrinfo(res);
-
-    SSL* ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, sock);
-    if (SSL_connect(ssl) <= 0) {
-        if (err) *err = "SSL_connect failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    // HTTP запрос
-    std::ostringstream req;
-    req << "POST /api/generate HTTP/1.1\r\n"
-        << "Host: " << cfg.host << "\r\n"
-        << "Content-Type: application/json\r\n"
-        << "Connection: close\r\n";
-    if (!cfg.api_key.empty()) req << "x-api-key: " << cfg.api_key << "\r\n";
-    req << "Content-Length: " << jsonBody.size() << "\r\n\r\n"
-        << jsonBody;
-
-    const std::string request_str = req.str();
-    if (SSL_write(ssl, request_str.c_str(), (int)request_str.size()) <= 0) {
-        if (err) *err = "SSL_write failed";
-        SSL_free(ssl); close(sock); SSL_CTX_free(ctx); return std::nullopt;
-    }
-
-    char buf[4096];
-    std::string response;
-    int bytes;
-    while ((bytes = SSL_read(ssl, buf, sizeof(buf)-1)) > 0) {
-        buf[bytes] = '\0';
-        response += buf;
-    }
+        const AiConfig& cfg, const std::string& jsonBody, std::string* err) const {
+    std::string headers;
+    if (!cfg.api_key.empty()) headers += "x-api-key: " + cfg.api_key + "\r\n";
 
-    SSL_free(ssl);
-    close(sock);
-    SSL_CTX_free(ctx);
+    // Соединение берётся из пула: повторные запросы идут без нового рукопожатия
+    auto response = pool_.post(cfg.host, cfg.port, "/api/generate", headers, jsonBody, err);
+    if (!response) return std::nullopt;
 
     // ----- Используем nlohmann::json для извлечения "text" -----
-    std::string text = extractTextFromJsonBody(response);
+    std::string text = extractTextFromJsonBody(response->body());
     if (text.empty()) {
         if (err) *err = "Cannot extract \"text\" from JSON response";
         return std::nullopt;
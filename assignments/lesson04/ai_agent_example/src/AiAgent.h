@@ -1,7 +1,9 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <optional>
 #include <nlohmann/json.hpp>
+#include "HttpsPool.h"
 
 struct AiConfig {
     std::string host;
@@ -26,15 +28,18 @@ public:
 
 private:
     // ---- низкоуровневые помощники ----
-    static std::optional<std::string> httpsPostGenerate(
-        const AiConfig& cfg, const std::string& jsonBody, std::string* err);
+    std::optional<std::string> httpsPostGenerate(
+        const AiConfig& cfg, const std::string& jsonBody, std::string* err) const;
 
     // Простой разбор JSON: ожидаем { "text": "<строка>" }
-    static std::string extractTextFromJsonBody(const std::string& body);
+    static std::string extractTextFromJsonBody(std::string_view body);
 
     static bool readWholeFile(const std::string& path, std::string& out, std::string* err);
 
 private:
     AiConfig cfg_;
     std::string prompt_;
+
+    // keep-alive соединения к API переживают отдельные вызовы ask()
+    mutable HttpsPool pool_;
 };
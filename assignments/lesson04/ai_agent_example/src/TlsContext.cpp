@@ -0,0 +1,74 @@
+#include "TlsContext.h"
+#include <csignal>
+
+#include <openssl/err.h>
+
+TlsContext& TlsContext::instance() {
+    // Инициализация статической локальной переменной потокобезопасна и выполняется один раз
+    static TlsContext ctx;
+    return ctx;
+}
+
+TlsContext::TlsContext() {
+    SSL_library_init();
+    SSL_load_error_strings();
+    OpenSSL_add_all_algorithms();
+
+    // Запись в уже закрытое сервером keep-alive соединение не должна убивать процесс
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ctx_ = SSL_CTX_new(TLS_client_method());
+    if (!ctx_) return;
+
+    key_index_ = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &TlsContext::freeKey);
+
+    // Сессии храним сами (по host:port), внутренний кэш OpenSSL клиенту не нужен
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx_, &TlsContext::onNewSession);
+}
+
+TlsContext::~TlsContext() {
+    for (auto& entry : sessions_) SSL_SESSION_free(entry.second);
+    sessions_.clear();
+    if (ctx_) SSL_CTX_free(ctx_);
+}
+
+void TlsContext::freeKey(void* /*parent*/, void* ptr, CRYPTO_EX_DATA* /*ad*/,
+                         int /*idx*/, long /*argl*/, void* /*argp*/) {
+    delete static_cast<std::string*>(ptr);
+}
+
+void TlsContext::prepare(SSL* ssl, const std::string& key) {
+    SSL_set_ex_data(ssl, key_index_, new std::string(key));
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) SSL_set_session(ssl, it->second);
+}
+
+void TlsContext::onHandshake(SSL* ssl) {
+    if (SSL_session_reused(ssl)) ++resumed_;
+    else ++full_;
+}
+
+void TlsContext::forget(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) return;
+    SSL_SESSION_free(it->second);
+    sessions_.erase(it);
+}
+
+// В TLS 1.3 билеты приходят уже после рукопожатия, поэтому сохраняем их здесь,
+// а не через SSL_get1_session сразу после SSL_connect
+int TlsContext::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    TlsContext& self = instance();
+    auto* key = static_cast<std::string*>(SSL_get_ex_data(ssl, self.key_index_));
+    if (!key) return 0;
+
+    std::lock_guard<std::mutex> lock(self.mtx_);
+    SSL_SESSION*& slot = self.sessions_[*key];
+    if (slot) SSL_SESSION_free(slot);
+    slot = session;
+    return 1;  // ссылка на session остаётся у нас
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include <openssl/ssl.h>
+
+// Общий для всего процесса TLS-контекст.
+// OpenSSL инициализируется один раз, все AiAgent работают через один SSL_CTX,
+// а полученные от сервера сессии (session tickets) кэшируются по host:port,
+// чтобы повторное подключение шло по сокращённому рукопожатию.
+class TlsContext {
+public:
+    // Счётчики рукопожатий
+    struct Stats {
+        uint64_t full = 0;
+        uint64_t resumed = 0;
+    };
+
+    static TlsContext& instance();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    SSL_CTX* ctx() const { return ctx_; }
+
+    // Привязать SSL к host:port и подставить сохранённую сессию (вызывать до SSL_connect)
+    void prepare(SSL* ssl, const std::string& key);
+
+    // Учесть завершённое рукопожатие: полное или возобновлённое
+    void onHandshake(SSL* ssl);
+
+    // Забыть сессию host:port (например, если сервер её не принял)
+    void forget(const std::string& key);
+
+    Stats stats() const { return { full_.load(), resumed_.load() }; }
+
+private:
+    TlsContext();
+    ~TlsContext();
+
+    // Колбэк OpenSSL на каждую новую сессию от сервера
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    static void freeKey(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+                        int idx, long argl, void* argp);
+
+private:
+    SSL_CTX* ctx_ = nullptr;
+    int key_index_ = -1;
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;
+
+    std::atomic<uint64_t> full_{0};
+    std::atomic<uint64_t> resumed_{0};
+};
@@ -32,8 +32,10 @@ bool AiAgent::loadConfig(const std::string& path, std::string* err) {
         if (j.contains("port")) cfg_.port = j.at("port").get<std::string>();
         cfg_.api_key = j.at("api_key").get<std::string>();
         if (j.contains("history_path")) cfg_.history_path = j.at("history_path").get<std::string>();
+        if (j.contains("prompts_path")) cfg_.prompts_path = j.at("prompts_path").get<std::string>();
         if (j.contains("max_saved_requests")) cfg_.max_requests = j.at("max_saved_requests").get<size_t>();
         if (j.contains("max_saved_bytes")) cfg_.max_history_bytes = j.at("max_saved_bytes").get<size_t>();
+        if (j.contains("max_saved_tokens")) cfg_.max_history_tokens = j.at("max_saved_tokens").get<size_t>();
         return true;
     } catch (const std::exception& e) {
         if (err) *err = std::string("Config parse error: ") + e.what();
@@ -149,17 +151,21 @@ std::optional<std::string> AiAgent::httpsPostGenerate(
 }
 
 std::optional<std::string> AiAgent::ask(std::string* outErr) const {
+    return ask(prompt_, outErr);
+}
+
+std::optional<std::string> AiAgent::ask(const std::string& prompt, std::string* outErr) const {
     if (cfg_.host.empty() || cfg_.api_key.empty()) {
         if (outErr) *outErr = "Config not loaded or api_key/host missing";
         return std::nullopt;
     }
-    if (prompt_.empty()) {
+    if (prompt.empty()) {
         if (outErr) *outErr = "Prompt is empty (load it first)";
         return std::nullopt;
     }
 
     // Формируем корректный JSON тела через nlohmann/json
-    json payload = { {"prompt", prompt_} };
+    json payload = { {"prompt", prompt} };
     const std::string body = payload.dump();
 
     return httpsPostGenerate(cfg_, body, outErr);
@@ -8,8 +8,10 @@ struct AiConfig {
     std::string port = "443";
     std::string api_key;
     std::optional<std::string> history_path = std::nullopt;
+    std::string prompts_path = "prompts";
     std::optional<size_t> max_requests = std::nullopt;
     std::optional<size_t> max_history_bytes = std::nullopt;
+    std::optional<size_t> max_history_tokens = std::nullopt;
 };
 
 class AiAgent {
@@ -24,6 +26,10 @@ public:
     // Возвращает std::nullopt при ошибке (описание в outErr, если передан)
     std::optional<std::string> ask(std::string* outErr = nullptr) const;
 
+    // То же с явным промптом: не трогает prompt_, поэтому годится для
+    // фоновых запросов параллельно с основным диалогом
+    std::optional<std::string> ask(const std::string& prompt, std::string* outErr = nullptr) const;
+
     // Явно задать промпт программно (не из файла)
     void setPrompt(std::string p) { prompt_ = std::move(p); }
 
@@ -0,0 +1,62 @@
+#include "History.h"
+#include "TokenBudget.h"
+
+using json = nlohmann::json;
+
+bool History::fromJson(const json& j, std::string* err) {
+    try {
+        clear();
+        if (j.contains("context")) {
+            context_ = j.at("context").get<std::string>();
+            bytes_ += context_.size();
+            tokens_ += approxTokens(context_);
+        }
+        if (j.contains("requests")) {
+            for (const auto& pair : j.at("requests")) {
+                append(pair.at(0).get<std::string>(), pair.at(1).get<std::string>());
+            }
+        }
+        return true;
+    } catch (const std::exception& e) {
+        if (err) *err = std::string("History parse error: ") + e.what();
+        clear();
+        return false;
+    }
+}
+
+void History::clear() {
+    context_.clear();
+    exchanges_.clear();
+    bytes_ = 0;
+    tokens_ = 0;
+}
+
+void History::count(const Exchange& e, bool add) {
+    const size_t b = e.request.size() + e.answer.size();
+    const size_t t = approxTokens(e.request) + approxTokens(e.answer);
+    if (add) {
+        bytes_ += b;
+        tokens_ += t;
+    } else {
+        bytes_ -= b;
+        tokens_ -= t;
+    }
+}
+
+void History::append(std::string request, std::string answer) {
+    exchanges_.push_back({std::move(request), std::move(answer)});
+    count(exchanges_.back(), true);
+}
+
+void History::compact(size_t n, std::string summary) {
+    bytes_ -= context_.size();
+    tokens_ -= approxTokens(context_);
+    context_ = std::move(summary);
+    bytes_ += context_.size();
+    tokens_ += approxTokens(context_);
+
+    for (size_t i = 0; i < n && !exchanges_.empty(); ++i) {
+        count(exchanges_.front(), false);
+        exchanges_.pop_front();
+    }
+}
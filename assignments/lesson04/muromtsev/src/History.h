@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <nlohmann/json.hpp>
+
+// Один обмен: запрос пользователя и ответ ментора
+struct Exchange {
+    std::string request;
+    std::string answer;
+};
+
+// История общения с пользователем: сжатый контекст и последние обмены.
+// Размер истории в байтах и токенах ведётся при каждом изменении, так что
+// проверка порогов сжатия — O(1), без обхода и сериализации всей истории.
+class History {
+public:
+    // Прежний формат файла истории: { "context": "...", "requests": [[запрос, ответ], ...] }
+    bool fromJson(const nlohmann::json& j, std::string* err = nullptr);
+
+    void clear();
+    void append(std::string request, std::string answer);
+
+    // Заменить контекст и первые n обменов сводкой. Обмены, добавленные
+    // после того, как сводка была заказана, остаются на месте
+    void compact(size_t n, std::string summary);
+
+    const std::string& context() const { return context_; }
+    const std::deque<Exchange>& exchanges() const { return exchanges_; }
+    size_t size() const { return exchanges_.size(); }
+    size_t bytes() const { return bytes_; }
+    size_t tokens() const { return tokens_; }
+
+private:
+    void count(const Exchange& e, bool add);
+
+    std::string context_;
+    std::deque<Exchange> exchanges_;
+    size_t bytes_ = 0;
+    size_t tokens_ = 0;
+};
@@ -0,0 +1,262 @@
+#include "HistoryLog.h"
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = {'P', 'M', 'L', 'O', 'G', '0', '1', '\n'};
+
+enum RecordType : uint32_t {
+    kExchange = 1,
+    kContext = 2
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t a_len;
+    uint32_t b_len;
+};
+
+std::string sysError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+// pwrite, а не O_APPEND: в Linux pwrite в файл с O_APPEND игнорирует
+// смещение, а заголовок нужно переписывать на месте
+bool writeAll(int fd, const char* data, size_t n, uint64_t off) {
+    while (n) {
+        const ssize_t w = ::pwrite(fd, data, n, static_cast<off_t>(off));
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += w;
+        n -= static_cast<size_t>(w);
+        off += static_cast<uint64_t>(w);
+    }
+    return true;
+}
+
+// Запись целиком, одним буфером: один write на ход
+std::string encode(uint32_t type, const std::string& a, const std::string& b) {
+    const RecordHeader h{type, static_cast<uint32_t>(a.size()), static_cast<uint32_t>(b.size())};
+    std::string rec;
+    rec.reserve(sizeof(h) + a.size() + b.size());
+    rec.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    rec += a;
+    rec += b;
+    return rec;
+}
+
+// Разобрать запись по смещению off; false — запись оборвана или испорчена
+bool decode(const char* base, uint64_t size, uint64_t off, RecordHeader& h, uint64_t& next) {
+    if (off + sizeof(h) > size) return false;
+    std::memcpy(&h, base + off, sizeof(h));
+    if (h.type != kExchange && h.type != kContext) return false;
+    next = off + sizeof(h) + h.a_len + h.b_len;
+    return next <= size;
+}
+
+} // namespace
+
+HistoryLog::~HistoryLog() {
+    close();
+}
+
+void HistoryLog::close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    size_ = 0;
+    context_off_ = 0;
+    context_size_ = 0;
+    live_.clear();
+}
+
+bool HistoryLog::writeHeader(std::string* err) {
+    char buf[kHeaderSize];
+    const uint64_t live = live_.empty() ? size_ : live_.front();
+    std::memcpy(buf, kMagic, 8);
+    std::memcpy(buf + 8, &context_off_, 8);
+    std::memcpy(buf + 16, &live, 8);
+    if (!writeAll(fd_, buf, sizeof(buf), 0)) {
+        if (err) *err = sysError("History log header write failed");
+        return false;
+    }
+    return true;
+}
+
+bool HistoryLog::open(const std::string& path, History& out, std::string* err) {
+    close();
+    out.clear();
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        if (err) *err = sysError("Cannot open history log " + path);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        if (err) *err = sysError("Cannot stat history log " + path);
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    if (size_ == 0) {
+        size_ = kHeaderSize;
+        return writeHeader(err);
+    }
+    if (size_ < kHeaderSize) {
+        if (err) *err = "History log is corrupted: " + path;
+        close();
+        return false;
+    }
+
+    // Отображаем файл целиком, но читаем только заголовок, запись контекста
+    // и хвост с живыми обменами: остальные страницы с диска не поднимаются
+    void* map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map == MAP_FAILED) {
+        if (err) *err = sysError("Cannot map history log " + path);
+        close();
+        return false;
+    }
+    const char* base = static_cast<const char*>(map);
+    uint64_t live_off = 0;
+    bool ok = std::memcmp(base, kMagic, 8) == 0;
+    if (ok) {
+        std::memcpy(&context_off_, base + 8, 8);
+        std::memcpy(&live_off, base + 16, 8);
+        ok = live_off >= kHeaderSize && live_off <= size_;
+    }
+    if (ok && context_off_) {
+        RecordHeader h;
+        uint64_t next;
+        ok = decode(base, size_, context_off_, h, next) && h.type == kContext;
+        if (ok) {
+            out.compact(0, std::string(base + context_off_ + sizeof(h), h.a_len));
+            context_size_ = next - context_off_;
+        }
+    }
+    if (!ok) {
+        ::munmap(map, size_);
+        if (err) *err = "History log is corrupted: " + path;
+        close();
+        return false;
+    }
+
+    uint64_t off = live_off;
+    RecordHeader h;
+    uint64_t next;
+    while (off < size_ && decode(base, size_, off, h, next)) {
+        if (h.type == kExchange) {
+            const char* p = base + off + sizeof(h);
+            out.append(std::string(p, h.a_len), std::string(p + h.a_len, h.b_len));
+            live_.push_back(off);
+        }
+        off = next;
+    }
+    ::munmap(map, size_);
+
+    // Хвост после последней целой записи — след оборванной записи
+    if (off < size_) {
+        if (::ftruncate(fd_, static_cast<off_t>(off)) != 0) {
+            if (err) *err = sysError("Cannot truncate history log " + path);
+            close();
+            return false;
+        }
+        size_ = off;
+    }
+    return true;
+}
+
+bool HistoryLog::append(uint32_t type, const std::string& a, const std::string& b, std::string* err) {
+    if (fd_ < 0) {
+        if (err) *err = "History log is not open";
+        return false;
+    }
+    const std::string rec = encode(type, a, b);
+    if (!writeAll(fd_, rec.data(), rec.size(), size_)) {
+        if (err) *err = sysError("History log write failed");
+        return false;
+    }
+    size_ += rec.size();
+    return true;
+}
+
+bool HistoryLog::appendExchange(const Exchange& e, std::string* err) {
+    // Заголовок не трогаем: при загрузке всё после первого живого обмена
+    // читается подряд, новый обмен найдётся сам
+    const uint64_t off = size_;
+    if (!append(kExchange, e.request, e.answer, err)) return false;
+    live_.push_back(off);
+    return true;
+}
+
+bool HistoryLog::appendContext(size_t n, const std::string& summary, std::string* err) {
+    const uint64_t off = size_;
+    if (!append(kContext, summary, std::string(), err)) return false;
+    context_off_ = off;
+    context_size_ = size_ - off;
+    for (size_t i = 0; i < n && !live_.empty(); ++i) live_.pop_front();
+    // Запись уже на диске: если заголовок не успеет обновиться, при запуске
+    // поднимется прошлое согласованное состояние
+    return writeHeader(err);
+}
+
+bool HistoryLog::shouldCompact() const {
+    // Живое — запись текущего контекста и всё начиная с первого живого обмена
+    const uint64_t live = (live_.empty() ? 0 : size_ - live_.front()) + context_size_;
+    const uint64_t total = size_ - kHeaderSize;
+    const uint64_t dead = total > live ? total - live : 0;
+    return dead >= kCompactMinBytes && dead > live;
+}
+
+bool HistoryLog::compact(const History& h, std::string* err) {
+    const std::string tmp = path_ + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        if (err) *err = sysError("Cannot create " + tmp);
+        return false;
+    }
+
+    std::string buf(kHeaderSize, '\0');
+    uint64_t context_off = 0;
+    if (!h.context().empty()) {
+        context_off = buf.size();
+        buf += encode(kContext, h.context(), std::string());
+    }
+    std::deque<uint64_t> live;
+    for (const auto& e : h.exchanges()) {
+        live.push_back(buf.size());
+        buf += encode(kExchange, e.request, e.answer);
+    }
+    const uint64_t live_off = live.empty() ? buf.size() : live.front();
+    std::memcpy(&buf[0], kMagic, 8);
+    std::memcpy(&buf[8], &context_off, 8);
+    std::memcpy(&buf[16], &live_off, 8);
+
+    const bool written = writeAll(fd, buf.data(), buf.size(), 0) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!written || ::rename(tmp.c_str(), path_.c_str()) != 0) {
+        if (err) *err = sysError("History log compaction failed");
+        ::unlink(tmp.c_str());
+        return false;
+    }
+
+    // Старый дескриптор указывает на удалённый файл — открываем новый
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = ::open(path_.c_str(), O_RDWR);
+    if (fd_ < 0) {
+        if (err) *err = sysError("Cannot reopen history log " + path_);
+        return false;
+    }
+    size_ = buf.size();
+    context_off_ = context_off;
+    context_size_ = context_off ? live_off - context_off : 0;
+    live_ = std::move(live);
+    return true;
+}
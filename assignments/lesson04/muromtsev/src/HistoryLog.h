@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <cstdint>
+#include "History.h"
+
+// Журнал истории пользователя: файл только дописывается, запись одного хода
+// стоит O(размер хода), а не O(всей истории).
+//
+// Формат (порядок байт — родной для машины):
+//   заголовок: "PMLOG01\n", u64 смещение последней записи контекста (0 — нет),
+//              u64 смещение первого живого обмена
+//   записи:    u32 тип, u32 длина a, u32 длина b, затем a и b байт
+//              (обмен: запрос и ответ; контекст: сводка, b пуст)
+//
+// Сжатие истории дописывает запись контекста и сдвигает в заголовке смещение
+// первого живого обмена, так что при запуске читается только хвост файла.
+// Когда мёртвая часть разрастается, файл переписывается целиком (compact).
+class HistoryLog {
+public:
+    HistoryLog() = default;
+    ~HistoryLog();
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    // Открыть (или создать) журнал и загрузить живую часть истории в out.
+    // Оборванная последняя запись (сбой посреди записи) отрезается
+    bool open(const std::string& path, History& out, std::string* err = nullptr);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+    // Есть ли в журнале что-нибудь, кроме заголовка
+    bool empty() const { return size_ <= kHeaderSize; }
+
+    bool appendExchange(const Exchange& e, std::string* err = nullptr);
+
+    // Сводка заменила контекст и первые n живых обменов (см. History::compact)
+    bool appendContext(size_t n, const std::string& summary, std::string* err = nullptr);
+
+    // Мёртвая часть журнала больше живой — пора переписать
+    bool shouldCompact() const;
+
+    // Переписать журнал по текущей истории: во временный файл и rename
+    bool compact(const History& h, std::string* err = nullptr);
+
+private:
+    static constexpr uint64_t kHeaderSize = 24;
+    static constexpr uint64_t kCompactMinBytes = 64 * 1024;
+
+    bool append(uint32_t type, const std::string& a, const std::string& b, std::string* err);
+    bool writeHeader(std::string* err);
+
+    std::string path_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    uint64_t context_off_ = 0;
+    uint64_t context_size_ = 0;   // размер записи текущего контекста
+    std::deque<uint64_t> live_;   // смещения живых обменов, от старых к новым
+};
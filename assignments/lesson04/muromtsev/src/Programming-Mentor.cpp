@@ -1,6 +1,7 @@
 #include "Programming-Mentor.hpp"
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
 
 const std::unordered_map<std::string, PM::REQUEST_TYPE> PM::inner_converter_ = {
     {"general", PM::REQUEST_TYPE::GENERAL_QUESTION},
@@ -20,24 +21,27 @@ void PM::printInfo()
 bool PM::loadHistory(std::string *err) 
 {
     if (!cfg_.history_path.has_value()) return false;
-    std::string s;
-    const std::string full_path = cfg_.history_path.value() + "/" + username_ + ".json";
-    if (!readWholeFile(full_path, s, err)) {
-        std::ofstream histfile {full_path};
-        histfile << R"({ "requests": [], "context": ""})";
-        histfile.close();
-        history_ = json::parse(R"({ "requests": [], "context": ""})");
+    const std::string base = cfg_.history_path.value() + "/" + username_;
+    if (!log_.open(base + ".log", history_, err)) {
+        std::cerr << "History error: " << (err ? *err : "") << '\n';
         return false;
     }
+    if (!log_.empty()) return true;
+
+    // Историю из прежнего JSON-файла один раз переносим в журнал
+    std::string s;
+    if (!readWholeFile(base + ".json", s, nullptr)) return false;
     try {
-        history_ = json::parse(s);
-        return true;
+        if (!history_.fromJson(json::parse(s), err)) return false;
     } catch (const std::exception& e) {
         if (err) *err = std::string("History parse error: ") + e.what();
-        history_ = json::parse(R"({ "requests": [], "context": ""})");
+        history_.clear();
         return false;
     }
-    return false;
+    if (!log_.compact(history_, err)) {
+        std::cerr << "History error: " << (err ? *err : "") << '\n';
+    }
+    return true;
 }
 
 void PM::determineRequestType(const std::string &request, std::string *err)
@@ -51,7 +55,9 @@ void PM::determineRequestType(const std::string &request, std::string *err)
     std::string key = *resp;
     auto it = inner_converter_.find(key);
     const auto type = (it != inner_converter_.end()) ? it->second : PM::REQUEST_TYPE::UNKNOWN;
-    if (shouldCompress(type)) compressHistory(err);
+    // Смена темы — повод свернуть всё накопленное, но не ждать этого
+    collectCompression(false);
+    if (shouldCompress(type)) startCompression(history_.size());
     last_type_ = type;
     promptBuilder(request, type, err);
 }
@@ -81,166 +87,132 @@ std::string PM::getUserRequest(std::string *err)
     return "";
 }
 
+bool PM::loadTemplates(std::string *err)
+{
+    const std::string dir = cfg_.prompts_path + "/";
+    auto load = [&](PromptTemplate& dst, const std::string& name,
+                    std::initializer_list<std::string_view> slots) {
+        auto t = PromptTemplate::load(dir + name + ".txt", slots, err);
+        if (!t) return false;
+        dst = std::move(*t);
+        return true;
+    };
+    if (!load(header_tpl_, "mentor_header", {"username"}) ||
+        !load(context_tpl_, "context", {"context"}) ||
+        !load(history_header_tpl_, "history_header", {}) ||
+        !load(history_item_tpl_, "history_item", {"request", "answer"}) ||
+        !load(separator_tpl_, "separator", {})) {
+        return false;
+    }
+    // Шаблон каждого типа запроса лежит в файле с его кодовым словом
+    for (const auto& [name, type] : inner_converter_) {
+        if (!load(type_tpl_[type], name, {"request"})) return false;
+    }
+    return true;
+}
+
 std::string PM::promptBuilder(const std::string& request, PM::REQUEST_TYPE type,  std::string *err)
 {
-    std::stringstream ss;
-    if ((type != PM::REQUEST_TYPE::REQUEST_TYPE_DETERMINATION) &&
-         type != PM::REQUEST_TYPE::COMPRESSION) {
-        ss << "Ты — ментор по программированию." << '\n';
-        ss << "Ты общаешься с пользователем по имени " << username_ << '\n';
-        ss << "Не здоровайся с пользователем, обращайся к нему на вы." << '\n';
-        auto history = history_.at("requests").get<std::vector<std::vector<std::string>>>();
-        auto context = history_.at("context").get<std::string>();
-        if (context.size()) {
-            ss << "Вот тот контекст информации о пользователе, что ты собрал на основе прошлого опыта общения с ним:" << '\n';
-            ss << context;
-            ss << "----------------------" << '\n';
-        }
-        if (history.size()) {
-            ss << "Вот предыдущие сохранённые запросы пользователя и твои ответы:" << '\n';
-            for (const auto& req_pair : history) {
-                ss << "----------------------\n";
-                ss << "Запрос пользователя: " << req_pair[0] << "\n"
-                   << "Твой ответ на него: " << req_pair[1] << "\n";
+    renderPrompt(prompt_, request, type, history_.size());
+    return prompt_;
+}
+
+void PM::renderPrompt(std::string &out, const std::string &request, PM::REQUEST_TYPE type, size_t exchanges) const
+{
+    // Стабильное идёт первым: шапка ментора, сжатый контекст, история (растёт
+    // только в конец), и лишь затем инструкция типа запроса и сам запрос.
+    // Сжатие собирается так же, поэтому делит префикс с обычными ходами
+    const bool with_history = type != PM::REQUEST_TYPE::REQUEST_TYPE_DETERMINATION;
+    const auto& context = history_.context();
+    const auto& requests = history_.exchanges();
+    const size_t n = std::min(exchanges, requests.size());
+    const auto end = requests.begin() + n;
+
+    // Сначала точный размер промпта, потом один проход по буферу нужной длины
+    size_t size = type_tpl_[type].renderedSize({request});
+    if (with_history) {
+        size += header_tpl_.renderedSize({username_});
+        if (context.size()) size += context_tpl_.renderedSize({context});
+        if (n) {
+            size += history_header_tpl_.literalSize();
+            for (auto it = requests.begin(); it != end; ++it) {
+                size += history_item_tpl_.renderedSize({it->request, it->answer});
             }
         }
-        ss << "----------------------" << '\n';
+        size += separator_tpl_.literalSize();
     }
-    switch (type) {
-        case PM::REQUEST_TYPE::REQUEST_TYPE_DETERMINATION: {
-            ss << "Ты - модуль ИИ-агента, определяющий тип запроса пользователя" << '\n';
-            ss << "По полученному от пользователя запросу ты должен определить его тип и выдать в ответе только одно кодовое слово, соотвествующее типу запроса." << '\n';
-            ss << "Существуют следующие типы запросов:" << '\n';
-            ss << "Общие вопросы - вопросы по синтаксису языка программирования, алгоритмам, работе с компьютером и утилитами - все вопросы без привязки к уже написанной программе. Кодовое слово для данного типа - general" << '\n';
-            ss << "Консультация по уже написанному коду - вопросы, связанные с улучшением работы уже написанной пользователем программы. Кодовое слово для данного типа - consultation" << '\n';
-            ss << "Отладка уже написанной программы - вопросы касательно некорректно работающих или не работающих совсем частей программы пользователя. Кодовое слово для данного типа - debug" << '\n';
-            ss << "Вопросы, не относяющие к типам, описанным выше - для них кодовое слово -  unknown" << '\n';
-            ss << "----------------------" << '\n';
-            ss << "Запрос пользователя следующий:" << '\n';
-            ss << request << '\n';
-            ss << "----------------------" << '\n';
-            ss << "В качестве ответа дай одно слово - кодовое слово, соответствующее типу запроса пользователя." << '\n';
-            break;
-        }
-        case PM::REQUEST_TYPE::GENERAL_QUESTION: {
-            ss << "Отвечай на следующий вопрос пользователя коротко." << '\n';
-            ss << "В ответе приводи небольшие листинги с кодом - примерами использования интересных пользователю конструкций и алгоритмов." << '\n';
-            ss << "Если есть возможность, постарайся объяснить тему пользователю без написания кода." << '\n';
-            ss << "Данный выше контекст диалога с пользователем используй минимально - пользователю должно быть всё понятно и без него." << '\n';
-            ss << "----------------------" << '\n';
-            ss << "Запрос пользователя следующий:" << '\n';
-            ss << request << '\n';
-            ss << "----------------------" << '\n';
-            break;
-        }
-        case PM::REQUEST_TYPE::CODE_CONSULTATION: {
-            ss << "Тебе необходимо будет проанализировать код пользователя и дать ему советы по его улучшению" << '\n';
-            ss << "Обращай внимание пользователя на его ошибки и недоработки, следующим образом: укажи строчку кода, напиши конструкцию, которую нужно доработать, затем объясни, зачем необходимо данное исправление и приведи свой уже исправленный вариант" << '\n';
-            ss << "Используя данный тебе выше контекст, укажи пользователю на те ошибки, которые он продолжает допускать даже после твоих замечаний, а также похвали его за те конструкции и приемы программирования, которые начали у него лучше получаться по сравнению с прошлыми его запросами" << '\n';
-            ss << "При указании на ошибки пользователя, будь предельно вежлив" << '\n';
-            ss << "Если в контексте выше пользователь объяснил, почему он не может принять твои исправления и замечания, прислушайся к нему" << '\n';
-            ss << "----------------------" << '\n';
-            ss << "Запрос пользователя следующий:" << '\n';
-            ss << request << '\n';
-            ss << "----------------------" << '\n';
-            break;
-        }
-        case PM::REQUEST_TYPE::CODE_DEBUGGING: {
-            ss << "Тебе нужно произвести отладку кода пользователя" << '\n';
-            ss << "Если ошибка синтаксическая - приведи вариант её устранения и объясни, зачем это нужно" << '\n';
-            ss << "Старайся не переписывать значительно код пользователя - меняй только те места, что необходимо" << '\n';
-            ss << "Если ошибка логическая - например, в логике работы алгоритма, исправь её и объясни, почему раньше программа могла работать некорректно" << '\n';
-            ss << "На основе данного тебе выше контекста подметь, в каких местах пользователь до этого уже совершал схожие ошибки и укажи пользователю на это" << '\n';
-            ss << "При указании на ошибки пользователя, будь предельно вежлив" << '\n';
-            ss << "Отвечай коротко и максимально по существу" << '\n';
-            ss << "----------------------" << '\n';
-            ss << "Запрос пользователя следующий:" << '\n';
-            ss << request << '\n';
-            ss << "----------------------" << '\n';
-            break;
-        }
-        case PM::REQUEST_TYPE::UNKNOWN: {
-            ss << "Запрос пользователя не является стандартным, действуй по ситуации." << '\n';
-            ss << "Если вопрос не касается программирования и Computer Science, вежливо скажи пользователю, что не можешь ему помочь." << '\n';
-            ss << "Запрос пользователя следующий:" << '\n';
-            ss << request << '\n';
-            ss << "----------------------" << '\n';
-            break;
-        }
-        case PM::REQUEST_TYPE::COMPRESSION: {
-            ss << "Ты — модуль, ответственный за сжатие контекста для ИИ-агента, консультирующего программистов." << '\n';
-            ss << "Ты получишь контекст и историю общения ИИ агента с пользователем." << '\n';
-            ss << "Твоя задача - сжать полученную информацию, при этом сохранив следующее:" << '\n';
-            ss << "1) Какие задачи, алгоритмы и темы ИИ-агент обсуждал с пользователем - пиши об этом максимально коротко" << '\n';
-            ss << "2) Какие рекомендации ИИ-агент давал пользователю, отдельно укажи, к каким пользователь прислушался, а какие - проигнорировал и почему" << '\n';
-            ss << "3) Что у пользователя получается делать на данный момент хорошо и в чём он разбирается" << '\n';
-            ss << "4) В чём, по мнению, ИИ-агента пользователь слабоват и на какие моменты ему стоит обратить внимание" << '\n';
-            ss << "5) Какую последнюю задачу ИИ-агент решал с пользователем, была ли она решена и если нет, то какие проблемы остались" << '\n';
-            ss << "Ты пишешь системную информацию, поэтому отвечай по существу" << '\n';
-            ss << "Ниже приведён контекст, который тебе необходимо сжать:" << '\n';
-            ss << "----------------------" << '\n';
-            auto history = history_.at("requests").get<std::vector<std::vector<std::string>>>();
-            auto context = history_.at("context").get<std::string>();
-            if (context.size()) {
-                ss << "Вот тот контекст информации о пользователе, что ты собрал на основе прошлого опыта общения с ним:" << '\n';
-                ss << context;
-                ss << "----------------------" << '\n';
-            }
-            if (history.size()) {
-                ss << "Вот предыдущие сохранённые запросы пользователя и твои ответы:" << '\n';
-                for (const auto &request : history) {
-                    ss << "----------------------" << '\n';
-                    ss << "Запрос пользователя: " << request[0] << '\n' << "Твой ответ на него: " << request[1] << '\n';
-                }
+
+    out.clear();
+    out.reserve(size);
+    if (with_history) {
+        header_tpl_.renderTo(out, {username_});
+        if (context.size()) context_tpl_.renderTo(out, {context});
+        if (n) {
+            history_header_tpl_.renderTo(out, {});
+            for (auto it = requests.begin(); it != end; ++it) {
+                history_item_tpl_.renderTo(out, {it->request, it->answer});
             }
-            ss << "----------------------" << '\n';
-            break;
         }
-        default: break;
+        separator_tpl_.renderTo(out, {});
     }
-    prompt_ = ss.str();
-    return prompt_;
+    type_tpl_[type].renderTo(out, {request});
 }
 
 void PM::saveSession()
 {
-    if (!cfg_.history_path) return;
-    const std::string full_path = *cfg_.history_path + "/" + username_ + ".json";
-    std::ofstream histfile(full_path, std::ios::trunc);
-    if (!histfile) {
-        std::cerr << "Failed to open history file: " << full_path << '\n';
-        return;
-    }
-    histfile << history_.dump(4);
+    // Обмены уже в журнале, осталось дождаться идущего сжатия
+    collectCompression(true);
 }
 
 void PM::saveHistory(const std::optional<std::string>& answer, const std::string &request)
 {
-    history_["requests"].push_back({request, answer.value_or("")});
-    if (shouldCompress(std::nullopt)) compressHistory(nullptr);
+    collectCompression(false);
+    history_.append(request, answer.value_or(""));
+    std::string log_err;
+    if (log_.isOpen() && !log_.appendExchange(history_.exchanges().back(), &log_err)) {
+        std::cerr << "History error: " << log_err << '\n';
+    }
+    // Сворачиваем старшую половину: свежие обмены остаются дословно
+    if (shouldCompress(std::nullopt)) startCompression((history_.size() + 1) / 2);
 }
 
-void PM::compressHistory(std::string *err)
+void PM::startCompression(size_t count)
 {
-    promptBuilder(" ", PM::inner_converter_.at("compression"), err);
-    auto resp = ask(err);
-    if (!resp || resp->empty()) {
-        if (err && !err->empty()) std::cerr << "Request failed: " << *err << '\n';
+    // Одновременно идёт не больше одного сжатия: следующее закажет
+    // очередной ход, если пороги всё ещё превышены
+    if (compression_.valid() || count == 0) return;
+    std::string prompt;
+    renderPrompt(prompt, " ", PM::REQUEST_TYPE::COMPRESSION, count);
+    compressing_ = count;
+    compression_ = std::async(std::launch::async, [this, prompt = std::move(prompt)]() {
+        Compression result;
+        result.summary = ask(prompt, &result.error);
+        return result;
+    });
+}
+
+void PM::collectCompression(bool wait)
+{
+    if (!compression_.valid()) return;
+    if (!wait && compression_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+    Compression result = compression_.get();
+    if (!result.summary || result.summary->empty()) {
+        if (!result.error.empty()) std::cerr << "Compression failed: " << result.error << '\n';
         return;
     }
-    std::string compressed_history = *resp;
-    if (compressed_history.size()) {
-        history_["context"] = compressed_history;
-        history_["requests"] = std::vector<std::vector<std::string>>();
-        saveSession();
+    history_.compact(compressing_, std::move(*result.summary));
+    if (!log_.isOpen()) return;
+    std::string log_err;
+    if (!log_.appendContext(compressing_, history_.context(), &log_err) ||
+        (log_.shouldCompact() && !log_.compact(history_, &log_err))) {
+        std::cerr << "History error: " << log_err << '\n';
     }
 }
 
-bool PM::shouldCompress(std::optional<PM::REQUEST_TYPE> nextType) {
-    const auto reqs = history_.at("requests").get<std::vector<std::vector<std::string>>>();
-    if (reqs.size() >= cfg_.max_requests.value_or(20)) return true;
-    const size_t bytes = history_.dump(0).size();
-    if (bytes >= cfg_.max_history_bytes.value_or(256 * 1024)) return true;
+bool PM::shouldCompress(std::optional<PM::REQUEST_TYPE> nextType) const {
+    if (history_.size() >= cfg_.max_requests.value_or(20)) return true;
+    if (history_.bytes() >= cfg_.max_history_bytes.value_or(256 * 1024)) return true;
+    if (cfg_.max_history_tokens && history_.tokens() >= *cfg_.max_history_tokens) return true;
     if (last_type_.has_value() && nextType.has_value() && last_type_.value() != nextType.value()) return true;
     return false;
-}
\ No newline at end of file
+}
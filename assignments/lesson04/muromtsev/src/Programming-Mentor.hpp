@@ -2,8 +2,13 @@
 #include <string>
 #include <optional>
 #include <unordered_map>
+#include <array>
+#include <future>
 #include <nlohmann/json.hpp>
 #include "AiAgent.h"
+#include "History.h"
+#include "HistoryLog.h"
+#include "PromptTemplate.h"
 
 using json = nlohmann::json;
 
@@ -15,23 +20,44 @@ enum REQUEST_TYPE {
     CODE_DEBUGGING, 
     REQUEST_TYPE_DETERMINATION,
     UNKNOWN,
-    COMPRESSION
+    COMPRESSION,
+    REQUEST_TYPE_COUNT
 };
 const static std::unordered_map<std::string, REQUEST_TYPE> inner_converter_;
 
 public:
+// Загрузить шаблоны промптов из каталога prompts_path (по умолчанию prompts)
+bool loadTemplates(std::string *err = nullptr);
 void printInfo();
 void userIntroduction(std::string *err = nullptr);
 void determineRequestType(const std::string &request, std::string *err  = nullptr);
 std::string promptBuilder(const std::string &request, PM::REQUEST_TYPE type,  std::string *err  = nullptr);
 std::string getUserRequest(std::string *err  = nullptr);
+// Дождаться фонового сжатия перед выходом
 void saveSession();
 void saveHistory(const std::optional<std::string> &answer, const std::string &request);
 private:
+// Результат фонового сжатия
+struct Compression {
+    std::optional<std::string> summary;
+    std::string error;
+};
+// Открыть журнал истории пользователя (<history_path>/<имя>.log)
 bool loadHistory(std::string *err  = nullptr);
-void compressHistory(std::string *err = nullptr);
-bool shouldCompress(std::optional<PM::REQUEST_TYPE> nextType);
+void renderPrompt(std::string &out, const std::string &request, PM::REQUEST_TYPE type, size_t exchanges) const;
+// Сжатие скользящее: в контекст сворачиваются только count старейших обменов.
+// Запрос к модели идёт в фоне, пока пользователь продолжает диалог
+void startCompression(size_t count);
+// Применить готовую сводку; wait — дождаться запроса, если он ещё идёт
+void collectCompression(bool wait);
+bool shouldCompress(std::optional<PM::REQUEST_TYPE> nextType) const;
 std::string username_;
-json history_;
+History history_;
+HistoryLog log_;
+std::future<Compression> compression_;
+size_t compressing_ = 0;   // сколько старейших обменов сворачивает идущий запрос
 std::optional<PM::REQUEST_TYPE> last_type_ = std::nullopt;
+// Шаблоны разбираются один раз при запуске
+PromptTemplate header_tpl_, context_tpl_, history_header_tpl_, history_item_tpl_, separator_tpl_;
+std::array<PromptTemplate, REQUEST_TYPE_COUNT> type_tpl_;
 };
\ No newline at end of file
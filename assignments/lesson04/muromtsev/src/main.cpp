@@ -17,6 +17,10 @@ int main(int argc, char **argv) {
             return 1;
         }
     }
+    if (!agent.loadTemplates(&err)) {
+        std::cerr << "Template error: " << err << "\n";
+        return 1;
+    }
     agent.printInfo();
     agent.userIntroduction(&err);
     std::string request = agent.getUserRequest(&err);